@@ -0,0 +1,394 @@
+#include "neural_network/layers/LayerConv2DMaxPooling2D.h"
+#include "neural_network/layers/LayerDense.h"
+#include "neural_network/utils/ActivationFunctions.h"
+#include "neural_network/utils/ConvoluteFunctions.h"
+#include "neural_network/utils/ConvolutePoolFunctions.h"
+#include "neural_network/utils/PoolFunctions.h"
+#include "neural_network/utils/WinogradFunctions.h"
+
+#include <nlohmann/json.hpp>
+#include <xtensor/generators/xrandom.hpp>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//measures the kernels of neural_network on shapes that ModelDueling gives them for every combination of
+//field size, channels number and batch size, the number of actions is the batch size of the actions branch,
+//so action counts are measured as batch sizes too
+//
+//usage: kernels_benchmark [--fields=8x8,10x10] [--channels=4,8] [--batches=1,10] [--actions=20,45]
+//	[--kernels=conv2D,dense] [--min-time=seconds] [--json=filename]
+//kernels are chosen by a part of their name, with --json=- json is written to the standard output instead of the table
+
+namespace
+{
+	//the first layer of ModelDueling
+	constexpr std::size_t filters_number = 10;
+	constexpr std::size_t kernel_size = 3;
+	constexpr nn::PoolSize pool_size{ 2, 2 };
+	//outputs of the first dense layer of the advantage
+	constexpr std::size_t dense_outputs_number = 20;
+
+	struct Options
+	{
+		std::vector<std::pair<std::size_t, std::size_t>> fields{ { 8, 8 }, { 10, 10 }, { 16, 16 } };
+		std::vector<std::size_t> channels{ 4, 8 };
+		std::vector<std::size_t> batches{ 1, 10, 32 };
+		std::vector<std::size_t> actions{ 20, 45 };
+		std::vector<std::string> kernels;
+		double min_time = 0.1;
+		std::size_t min_calls = 3;
+		std::string json_filename;
+	};
+
+	struct Case
+	{
+		std::size_t height;
+		std::size_t width;
+		std::size_t channels;
+		std::size_t batch;
+		//either "minibatch" or "actions"
+		std::string batch_kind;
+	};
+
+	struct Result
+	{
+		std::string kernel;
+		Case benchmark_case;
+		std::size_t calls;
+		double nanoseconds_per_call;
+		//for pooling flops are comparisons or additions, for activations they are evaluations of the function
+		double flops_per_call;
+	};
+
+	std::vector<std::string> split(const std::string& list)
+	{
+		std::vector<std::string> items;
+		std::stringstream stream(list);
+		for (std::string item; std::getline(stream, item, ',');)
+			if (!item.empty())
+				items.push_back(item);
+		return items;
+	}
+
+	Options parse_options(int argc, char** argv)
+	{
+		Options options;
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string argument = argv[i];
+			const std::size_t equals = argument.find('=');
+			const std::string name = argument.substr(0, equals);
+			const std::string value = equals == std::string::npos ? std::string() : argument.substr(equals + 1);
+			const auto sizes = [&] {
+				std::vector<std::size_t> numbers;
+				for (const std::string& item : split(value))
+					numbers.push_back(std::stoul(item));
+				return numbers;
+			};
+			if (name == "--fields")
+			{
+				options.fields.clear();
+				for (const std::string& item : split(value))
+				{
+					const std::size_t x = item.find('x');
+					const std::size_t height = std::stoul(item.substr(0, x));
+					options.fields.emplace_back(height, x == std::string::npos ? height : std::stoul(item.substr(x + 1)));
+				}
+			}
+			else if (name == "--channels")
+				options.channels = sizes();
+			else if (name == "--batches")
+				options.batches = sizes();
+			else if (name == "--actions")
+				options.actions = sizes();
+			else if (name == "--kernels")
+				options.kernels = split(value);
+			else if (name == "--min-time")
+				options.min_time = std::stod(value);
+			else if (name == "--json")
+				options.json_filename = value;
+			else
+				throw std::invalid_argument("unknown option " + argument);
+		}
+		return options;
+	}
+
+	//prepare is called before every call and is not timed, the first call warms up caches and thread local buffers
+	std::pair<std::size_t, double> measure(const Options& options, const std::function<void()>& prepare,
+		const std::function<void()>& call)
+	{
+		prepare();
+		call();
+		const double min_nanoseconds = options.min_time * 1e9;
+		double nanoseconds = 0;
+		std::size_t calls = 0;
+		while (calls < options.min_calls || nanoseconds < min_nanoseconds)
+		{
+			prepare();
+			const auto start = std::chrono::steady_clock::now();
+			call();
+			nanoseconds += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+			calls++;
+		}
+		return { calls, nanoseconds / calls };
+	}
+
+	class Benchmark
+	{
+	private:
+		const Options& options;
+		std::vector<Result> results;
+
+		bool selected(const std::string& kernel) const
+		{
+			if (options.kernels.empty())
+				return true;
+			for (const std::string& part : options.kernels)
+				if (kernel.find(part) != std::string::npos)
+					return true;
+			return false;
+		}
+
+		void run(const std::string& kernel, const Case& benchmark_case, double flops, const std::function<void()>& prepare,
+			const std::function<void()>& call)
+		{
+			if (!selected(kernel))
+				return;
+			const auto [calls, nanoseconds] = measure(options, prepare, call);
+			results.push_back({ kernel, benchmark_case, calls, nanoseconds, flops });
+		}
+
+		void run(const std::string& kernel, const Case& benchmark_case, double flops, const std::function<void()>& call)
+		{
+			run(kernel, benchmark_case, flops, [] {}, call);
+		}
+
+		void run_convolution(const Case& c);
+		void run_convolution_pooling(const Case& c);
+		void run_pooling(const Case& c);
+		void run_activations(const Case& c);
+		void run_layers(const Case& c);
+
+	public:
+		explicit Benchmark(const Options& options_to_set) : options(options_to_set) {}
+
+		void run_case(const Case& c)
+		{
+			run_convolution(c);
+			run_convolution_pooling(c);
+			run_pooling(c);
+			run_activations(c);
+			run_layers(c);
+		}
+
+		void print_table(std::ostream& out) const;
+		void write_json(std::ostream& out) const;
+	};
+
+	void Benchmark::run_convolution(const Case& c)
+	{
+		const std::array inputs_shape{ c.batch, c.height, c.width, c.channels };
+		const std::array filters_shape{ filters_number, kernel_size, kernel_size, c.channels };
+		const std::array outputs_shape{ c.batch, c.height - kernel_size + 1, c.width - kernel_size + 1, filters_number };
+		const xt::xarray<float> inputs = xt::random::rand<float>(inputs_shape);
+		const xt::xarray<float> filters = xt::random::rand<float>(filters_shape);
+		const xt::xarray<float> deltas = xt::random::rand<float>(outputs_shape);
+		const double flops = 2.0 * c.batch * outputs_shape[1] * outputs_shape[2] * filters.size();
+		xt::xarray<float> result;
+		run("conv2D_reference", c, flops, [&] { result = nn::convolute2D(inputs, filters, outputs_shape); });
+		run("conv2D_gemm", c, flops, [&] { result = nn::convolute2D_gemm(inputs, filters, outputs_shape); });
+		//filters are transformed once per update of the trainable vars, so the transform is measured on its own
+		std::vector<float> transformed_filters;
+		run("winograd_transform_filters", c, 0, [&] { nn::winograd_transform_filters(filters, transformed_filters); });
+		run("conv2D_winograd", c, flops, [&] {
+			result = nn::convolute2D_winograd(inputs, transformed_filters, outputs_shape);
+		});
+		run("conv2D_filters_derivative", c, flops, [&] {
+			result = nn::convolute2D_filters_derivative(inputs, deltas, filters_shape);
+		});
+		run("conv2D_inputs_derivative", c, flops, [&] {
+			result = nn::convolute2D_inputs_derivative(deltas, filters, inputs_shape);
+		});
+	}
+
+	//the fused kernels of the first layer, which uses the Winograd one for its 3x3 filters and 2x2 pooling,
+	//flops are the ones of the convolution alone, as for the separate kernels
+	void Benchmark::run_convolution_pooling(const Case& c)
+	{
+		const std::size_t conv_height = c.height - kernel_size + 1;
+		const std::size_t conv_width = c.width - kernel_size + 1;
+		const std::array filters_shape{ filters_number, kernel_size, kernel_size, c.channels };
+		const std::array outputs_shape{ c.batch, (conv_height - 1) / pool_size.first + 1,
+			(conv_width - 1) / pool_size.second + 1, filters_number };
+		const xt::xarray<float> inputs = xt::random::rand<float>({ c.batch, c.height, c.width, c.channels });
+		const xt::xarray<float> filters = xt::random::rand<float>(filters_shape);
+		std::vector<float> transformed_filters;
+		nn::winograd_transform_filters(filters, transformed_filters);
+		const double flops = 2.0 * c.batch * conv_height * conv_width * filters.size();
+		std::vector<std::size_t> switches(c.batch * outputs_shape[1] * outputs_shape[2] * filters_number);
+		xt::xarray<float> result;
+		run("conv2D_maxpool2D_gemm", c, flops, [&] {
+			result = nn::convolute2D_maxpool2D_gemm(inputs, filters, 0, 0, conv_height, conv_width, pool_size, outputs_shape,
+				switches.data());
+		});
+		run("conv2D_maxpool2D_winograd", c, flops, [&] {
+			result = nn::convolute2D_maxpool2D_winograd(inputs, transformed_filters, 0, 0, conv_height, conv_width,
+				outputs_shape, switches.data());
+		});
+	}
+
+	//pooling is measured on the outputs of the convolution of the first layer
+	void Benchmark::run_pooling(const Case& c)
+	{
+		const std::array inputs_shape{ c.batch, c.height - kernel_size + 1, c.width - kernel_size + 1, filters_number };
+		const std::array outputs_shape{ c.batch, (inputs_shape[1] - 1) / pool_size.first + 1,
+			(inputs_shape[2] - 1) / pool_size.second + 1, filters_number };
+		const xt::xarray<float> inputs = xt::random::rand<float>(inputs_shape);
+		const xt::xarray<float> deltas = xt::random::rand<float>(outputs_shape);
+		std::vector<std::size_t> switches;
+		xt::xarray<float> result;
+		run("maxpool2D", c, (double)inputs.size(), [&] { result = nn::maxpool2D(inputs, outputs_shape, pool_size); });
+		run("maxpool2D_switches", c, (double)inputs.size(), [&] {
+			result = nn::maxpool2D(inputs, outputs_shape, pool_size, &switches);
+		});
+		nn::maxpool2D(inputs, outputs_shape, pool_size, &switches);
+		run("unmaxpool2D", c, (double)deltas.size(), [&] { result = nn::unmaxpool2D(switches, deltas, inputs_shape); });
+	}
+
+	//activations are measured on the outputs of the convolution of the first layer
+	void Benchmark::run_activations(const Case& c)
+	{
+		const std::array shape{ c.batch, c.height - kernel_size + 1, c.width - kernel_size + 1, filters_number };
+		const xt::xarray<float> inputs = xt::random::rand<float>(shape, -1.0f, 1.0f);
+		const xt::xarray<float> biases = xt::random::rand<float>({ filters_number });
+		const xt::xarray<float> deltas = xt::random::rand<float>(shape);
+		const std::array<std::pair<const char*, nn::Activation>, 4> activations{ {
+			{ "sigmoid", nn::Activation::Sigmoid }, { "tanh", nn::Activation::Tanh }, { "relu", nn::Activation::ReLU },
+			{ "leaky_relu", nn::Activation::LeakyReLU } } };
+		xt::xarray<float> data;
+		for (const auto& [name, activation] : activations)
+		{
+			run(std::string("bias_activate_") + name, c, (double)inputs.size(), [&] { data = inputs; },
+				[&] { nn::bias_activate(data, biases, activation); });
+			run(std::string("derive_multiply_") + name, c, (double)inputs.size(), [&] { data = deltas; },
+				[&] { nn::derive_multiply(data, inputs, activation); });
+		}
+	}
+
+	//layers are called through their public interface, so forward includes the tape and backward includes
+	//the derivatives of the activation and of the trainable vars
+	void Benchmark::run_layers(const Case& c)
+	{
+		std::vector<std::size_t> conv_shape{ c.batch, c.height, c.width, c.channels };
+		nn::LayerConv2DMaxPooling2D conv_layer(filters_number, nn::KernelSize{ kernel_size, kernel_size }, nn::Padding::Valid,
+			nn::Activation::Sigmoid, pool_size);
+		conv_layer.build(conv_shape);
+		const xt::xarray<float> conv_inputs = xt::random::rand<float>({ c.batch, c.height, c.width, c.channels });
+		const double conv_flops = 2.0 * c.batch * (c.height - kernel_size + 1) * (c.width - kernel_size + 1) *
+			filters_number * kernel_size * kernel_size * c.channels;
+
+		std::vector<std::size_t> dense_shape{ c.batch, c.height * c.width * c.channels };
+		nn::LayerDense dense_layer(dense_outputs_number, nn::Activation::Sigmoid);
+		dense_layer.build(dense_shape);
+		const xt::xarray<float> dense_inputs = xt::random::rand<float>({ c.batch, c.height * c.width * c.channels });
+		const double dense_flops = 2.0 * c.batch * c.height * c.width * c.channels * dense_outputs_number;
+
+		const auto run_layer = [&](const std::string& name, const nn::Layer& layer, const xt::xarray<float>& inputs,
+			double flops) {
+			xt::xarray<float> data;
+			run(name + "_forward", c, flops, [&] { data = inputs; }, [&] { layer.forward(data, nullptr); });
+			nn::Tape tape;
+			xt::xarray<float> outputs = inputs;
+			layer.forward(outputs, &tape);
+			const xt::xarray<float> deltas = xt::random::rand<float>(outputs.shape());
+			xt::xarray<float> backward_outputs;
+			xt::xarray<float> backward_deltas;
+			nn::GradientMap gradient_map;
+			run(name + "_backward", c, 2 * flops, [&] {
+				backward_outputs = outputs;
+				backward_deltas = deltas;
+				gradient_map.clear();
+			}, [&] { layer.backward(backward_outputs, backward_deltas, tape, gradient_map); });
+		};
+		run_layer("conv2D_maxpool2D_layer", conv_layer, conv_inputs, conv_flops);
+		run_layer("dense_layer", dense_layer, dense_inputs, dense_flops);
+	}
+
+	void Benchmark::print_table(std::ostream& out) const
+	{
+		char line[256];
+		std::snprintf(line, sizeof(line), "%-32s %7s %4s %5s %-9s %14s %9s\n", "kernel", "field", "ch", "batch", "kind",
+			"ns/call", "GFLOP/s");
+		out << line;
+		for (const Result& result : results)
+		{
+			const Case& c = result.benchmark_case;
+			const std::string field = std::to_string(c.height) + "x" + std::to_string(c.width);
+			std::snprintf(line, sizeof(line), "%-32s %7s %4zu %5zu %-9s %14.0f %9.3f\n", result.kernel.c_str(), field.c_str(),
+				c.channels, c.batch, c.batch_kind.c_str(), result.nanoseconds_per_call,
+				result.flops_per_call / result.nanoseconds_per_call);
+			out << line;
+		}
+	}
+
+	void Benchmark::write_json(std::ostream& out) const
+	{
+		nlohmann::json json_results = nlohmann::json::array();
+		for (const Result& result : results)
+		{
+			const Case& c = result.benchmark_case;
+			json_results.push_back({ { "kernel", result.kernel }, { "height", c.height }, { "width", c.width },
+				{ "channels", c.channels }, { "batch", c.batch }, { "batch_kind", c.batch_kind }, { "calls", result.calls },
+				{ "ns_per_call", result.nanoseconds_per_call }, { "flops_per_call", result.flops_per_call },
+				{ "gflops", result.flops_per_call / result.nanoseconds_per_call } });
+		}
+		const nlohmann::json report{ { "build_type", DQN_BUILD_TYPE }, { "compiler", __VERSION__ },
+			{ "min_time", options.min_time }, { "results", json_results } };
+		out << report.dump(1, '\t') << '\n';
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	try
+	{
+		options = parse_options(argc, argv);
+	}
+	catch (const std::exception& exception)
+	{
+		std::cerr << exception.what() << '\n';
+		return 1;
+	}
+	xt::random::seed(0);
+	Benchmark benchmark(options);
+	for (const auto& [height, width] : options.fields)
+		for (const std::size_t channels : options.channels)
+		{
+			if (height < kernel_size || width < kernel_size)
+				continue;
+			for (const std::size_t batch : options.batches)
+				benchmark.run_case({ height, width, channels, batch, "minibatch" });
+			for (const std::size_t actions : options.actions)
+				benchmark.run_case({ height, width, channels, actions, "actions" });
+		}
+	if (options.json_filename != "-")
+		benchmark.print_table(std::cout);
+	if (options.json_filename == "-")
+		benchmark.write_json(std::cout);
+	else if (!options.json_filename.empty())
+	{
+		std::ofstream out_file(options.json_filename);
+		benchmark.write_json(out_file);
+	}
+	return 0;
+}
@@ -0,0 +1,314 @@
+#include "dqn/Q.h"
+
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#if __has_include(<sys/resource.h>)
+#include <sys/resource.h>
+#endif
+
+//plays synthetic episodes through dqn::Q with random boards, as call_network_debug does, to find out
+//how many steps per second an agent makes and how much memory it takes
+//
+//usage: selfplay_benchmark [--field=10x10] [--channels=4] [--actions=20,45] [--agents=1] [--steps=2000]
+//	[--warmup=100] [--episode=50] [--workers=1] [--background] [--batch-size=10] [--train-local=10]
+//	[--update-target=300] [--min-trace=15] [--max-trace=500] [--replay-precision=float|half|bfloat16]
+//	[--targets-refresh=0] [--save-dir=directory/] [--json=filename]
+//steps are counted per agent, the first warmup steps of every agent are not measured,
+//with --json=- json is written to the standard output instead of the summary
+//
+//agents take turns on the calling thread, as they do in a game, since every Q uses the default random engine
+//of xtensor, threads of an agent are its training workers and, with --background, its learner
+
+namespace
+{
+	struct Options
+	{
+		std::size_t field_height = 10;
+		std::size_t field_width = 10;
+		std::size_t channels = 4;
+		std::size_t min_actions = 20;
+		std::size_t max_actions = 45;
+		std::size_t agents = 1;
+		std::size_t steps = 2000;
+		std::size_t warmup = 100;
+		std::size_t episode = 50;
+		//by default agents save into a new temporary directory, which is removed afterwards,
+		//so that every run starts from untrained agents with the initial eps
+		std::string save_dir;
+		std::string json_filename;
+		dqn::QParameters parameters;
+	};
+
+	struct Report
+	{
+		std::size_t measured_steps = 0;
+		double seconds = 0;
+		//of every measured call_network with actions, in microseconds
+		std::vector<double> latencies;
+		double training_seconds = 0;
+		std::uint64_t training_steps = 0;
+		long peak_rss_kilobytes = 0;
+		std::vector<dqn::QStats> agents_stats;
+	};
+
+	std::vector<std::size_t> split_sizes(const std::string& list, char separator)
+	{
+		std::vector<std::size_t> sizes;
+		std::stringstream stream(list);
+		for (std::string item; std::getline(stream, item, separator);)
+			sizes.push_back(std::stoul(item));
+		return sizes;
+	}
+
+	Options parse_options(int argc, char** argv)
+	{
+		Options options;
+		dqn::QParameters& parameters = options.parameters;
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string argument = argv[i];
+			const std::size_t equals = argument.find('=');
+			const std::string name = argument.substr(0, equals);
+			const std::string value = equals == std::string::npos ? std::string() : argument.substr(equals + 1);
+			if (name == "--field")
+			{
+				const std::vector<std::size_t> sizes = split_sizes(value, 'x');
+				options.field_height = sizes.at(0);
+				options.field_width = sizes.size() > 1 ? sizes[1] : sizes[0];
+			}
+			else if (name == "--channels")
+				options.channels = std::stoul(value);
+			else if (name == "--actions")
+			{
+				const std::vector<std::size_t> sizes = split_sizes(value, ',');
+				options.min_actions = sizes.at(0);
+				options.max_actions = sizes.size() > 1 ? sizes[1] : sizes[0];
+			}
+			else if (name == "--agents")
+				options.agents = std::stoul(value);
+			else if (name == "--steps")
+				options.steps = std::stoul(value);
+			else if (name == "--warmup")
+				options.warmup = std::stoul(value);
+			else if (name == "--episode")
+				options.episode = std::stoul(value);
+			else if (name == "--workers")
+				parameters.workers_number = std::stoul(value);
+			else if (name == "--background")
+				parameters.background_training = true;
+			else if (name == "--batch-size")
+				parameters.batch_size = std::stoul(value);
+			else if (name == "--train-local")
+				parameters.train_local = std::stoi(value);
+			else if (name == "--update-target")
+				parameters.update_target = std::stoi(value);
+			else if (name == "--min-trace")
+				parameters.min_trace = std::stoul(value);
+			else if (name == "--max-trace")
+				parameters.max_trace = std::stoul(value);
+			else if (name == "--targets-refresh")
+				parameters.targets_refresh_number = std::stoul(value);
+			else if (name == "--replay-precision")
+			{
+				if (value == "float")
+					parameters.replay_precision = dqn::ReplayPrecision::Float;
+				else if (value == "half")
+					parameters.replay_precision = dqn::ReplayPrecision::Half;
+				else if (value == "bfloat16")
+					parameters.replay_precision = dqn::ReplayPrecision::BFloat16;
+				else
+					throw std::invalid_argument("unknown replay precision " + value);
+			}
+			else if (name == "--save-dir")
+				options.save_dir = value;
+			else if (name == "--json")
+				options.json_filename = value;
+			else
+				throw std::invalid_argument("unknown option " + argument);
+		}
+		if (options.min_actions == 0 || options.min_actions > options.max_actions)
+			throw std::invalid_argument("actions must be given as min,max with 0 < min <= max");
+		if (options.episode == 0)
+			throw std::invalid_argument("episode must not be 0");
+		return options;
+	}
+
+	long peak_rss_kilobytes()
+	{
+#if __has_include(<sys/resource.h>)
+		rusage usage{};
+		if (getrusage(RUSAGE_SELF, &usage) == 0)
+			return usage.ru_maxrss;
+#endif
+		return 0;
+	}
+
+	double percentile(const std::vector<double>& sorted, double fraction)
+	{
+		if (sorted.empty())
+			return 0;
+		const std::size_t rank = std::min(sorted.size() - 1, (std::size_t)(fraction * sorted.size()));
+		return sorted[rank];
+	}
+
+	Report run(const Options& options)
+	{
+		std::filesystem::create_directories(options.save_dir);
+		std::vector<std::unique_ptr<dqn::Q>> agents;
+		for (std::size_t agent = 0; agent < options.agents; ++agent)
+			agents.push_back(std::make_unique<dqn::Q>(options.field_height, options.field_width, options.channels,
+				"selfplay" + std::to_string(agent), options.save_dir, options.parameters));
+		std::mt19937 engine(0);
+		std::uniform_int_distribution<std::size_t> actions_distribution(options.min_actions, options.max_actions);
+		std::uniform_real_distribution<float> reward_distribution(-1.0f, 1.0f);
+
+		Report report;
+		report.latencies.reserve(options.agents * (options.steps - std::min(options.steps, options.warmup)));
+		std::vector<double> training_seconds_before(options.agents);
+		std::vector<std::uint64_t> training_steps_before(options.agents);
+		auto measure_start = std::chrono::steady_clock::now();
+		for (std::size_t step = 0; step < options.steps; ++step)
+		{
+			//training done during warmup is not counted either
+			if (step == options.warmup)
+			{
+				for (std::size_t agent = 0; agent < options.agents; ++agent)
+				{
+					const dqn::QStats stats = agents[agent]->stats();
+					training_seconds_before[agent] = stats.training_step_time * stats.training_steps / 1e3;
+					training_steps_before[agent] = stats.training_steps;
+				}
+				measure_start = std::chrono::steady_clock::now();
+			}
+			const bool measured = step >= options.warmup;
+			for (auto& agent : agents)
+			{
+				const std::size_t actions_number = actions_distribution(engine);
+				const auto start = std::chrono::steady_clock::now();
+				agent->call_network_debug(reward_distribution(engine), actions_number);
+				if (measured)
+					report.latencies.push_back(
+						std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+				if ((step + 1) % options.episode == 0)
+				{
+					agent->call_network_debug(reward_distribution(engine), 0);
+					agent->soft_reset();
+				}
+			}
+			if (measured)
+				report.measured_steps += options.agents;
+		}
+		report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - measure_start).count();
+		for (std::size_t agent = 0; agent < options.agents; ++agent)
+		{
+			const dqn::QStats stats = agents[agent]->stats();
+			report.training_seconds += stats.training_step_time * stats.training_steps / 1e3 - training_seconds_before[agent];
+			report.training_steps += stats.training_steps - training_steps_before[agent];
+			report.agents_stats.push_back(stats);
+		}
+		//agents save their checkpoints when they are destroyed, which is not part of the measurement
+		agents.clear();
+		report.peak_rss_kilobytes = peak_rss_kilobytes();
+		std::sort(report.latencies.begin(), report.latencies.end());
+		return report;
+	}
+
+	nlohmann::json to_json(const Options& options, const Report& report)
+	{
+		const char* precision_names[] = { "float", "half", "bfloat16" };
+		const dqn::QParameters& parameters = options.parameters;
+		const std::vector<double>& latencies = report.latencies;
+		nlohmann::json agents = nlohmann::json::array();
+		for (const dqn::QStats& stats : report.agents_stats)
+			agents.push_back({ { "training_steps", stats.training_steps }, { "target_updates", stats.target_updates },
+				{ "replay_size", stats.replay_size }, { "mean_priority", stats.mean_priority }, { "eps", stats.eps },
+				{ "beta", stats.beta } });
+		return {
+			{ "configuration", {
+				{ "field_height", options.field_height }, { "field_width", options.field_width },
+				{ "channels", options.channels }, { "min_actions", options.min_actions },
+				{ "max_actions", options.max_actions }, { "agents", options.agents }, { "steps", options.steps },
+				{ "warmup", options.warmup }, { "episode", options.episode },
+				{ "workers_number", parameters.workers_number },
+				{ "background_training", parameters.background_training }, { "batch_size", parameters.batch_size },
+				{ "train_local", parameters.train_local }, { "update_target", parameters.update_target },
+				{ "min_trace", parameters.min_trace }, { "max_trace", parameters.max_trace },
+				{ "replay_precision", precision_names[static_cast<std::size_t>(parameters.replay_precision)] },
+				{ "targets_refresh_number", parameters.targets_refresh_number } } },
+			{ "measured_steps", report.measured_steps },
+			{ "seconds", report.seconds },
+			{ "steps_per_second", report.measured_steps / report.seconds },
+			{ "action_latency_us", {
+				{ "p50", percentile(latencies, 0.5) }, { "p90", percentile(latencies, 0.9) },
+				{ "p99", percentile(latencies, 0.99) }, { "p999", percentile(latencies, 0.999) },
+				{ "max", latencies.empty() ? 0.0 : latencies.back() } } },
+			{ "training_steps", report.training_steps },
+			{ "training_seconds", report.training_seconds },
+			{ "training_time_share", report.training_seconds / report.seconds },
+			{ "peak_rss_kilobytes", report.peak_rss_kilobytes },
+			{ "agents", agents }
+		};
+	}
+
+	void print_summary(std::ostream& out, const nlohmann::json& summary)
+	{
+		const nlohmann::json& latency = summary["action_latency_us"];
+		char line[256];
+		std::snprintf(line, sizeof(line), "steps: %zu in %.3f s, %.1f steps/s\n",
+			summary["measured_steps"].get<std::size_t>(), summary["seconds"].get<double>(),
+			summary["steps_per_second"].get<double>());
+		out << line;
+		std::snprintf(line, sizeof(line), "action latency, us: p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+			latency["p50"].get<double>(), latency["p90"].get<double>(), latency["p99"].get<double>(),
+			latency["p999"].get<double>(), latency["max"].get<double>());
+		out << line;
+		std::snprintf(line, sizeof(line), "training: %llu steps, %.3f s, %.1f%% of the time\n",
+			(unsigned long long)summary["training_steps"].get<std::uint64_t>(), summary["training_seconds"].get<double>(),
+			100 * summary["training_time_share"].get<double>());
+		out << line;
+		std::snprintf(line, sizeof(line), "peak rss: %.1f MiB\n", summary["peak_rss_kilobytes"].get<long>() / 1024.0);
+		out << line;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	try
+	{
+		options = parse_options(argc, argv);
+	}
+	catch (const std::exception& exception)
+	{
+		std::cerr << exception.what() << '\n';
+		return 1;
+	}
+	const bool temporary_save_dir = options.save_dir.empty();
+	if (temporary_save_dir)
+		options.save_dir = (std::filesystem::temp_directory_path() /
+			("dqn_selfplay_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()))).string() + "/";
+	const nlohmann::json summary = to_json(options, run(options));
+	if (temporary_save_dir)
+		std::filesystem::remove_all(options.save_dir);
+	if (options.json_filename != "-")
+		print_summary(std::cout, summary);
+	if (options.json_filename == "-")
+		std::cout << summary.dump(1, '\t') << '\n';
+	else if (!options.json_filename.empty())
+	{
+		std::ofstream out_file(options.json_filename);
+		out_file << summary.dump(1, '\t') << '\n';
+	}
+	return 0;
+}
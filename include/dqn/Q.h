@@ -4,9 +4,19 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <cstddef>
+#include <cstdint>
 
 namespace dqn
 {
+	//precision in which boards are kept in the replay memory, boards are widened to float when a batch is gathered
+	enum class ReplayPrecision
+	{
+		Float,
+		Half,
+		BFloat16
+	};
+
 	//parameters to configure dqn
 	struct QParameters
 	{
@@ -24,6 +34,52 @@ namespace dqn
 		std::size_t batch_size = 10;
 		std::size_t min_trace = 15;
 		std::size_t max_trace = 500;
+		//threads used for training, 0 means one per hardware thread,
+		//every Q starts its own, so the default keeps games with many agents from oversubscribing the cores
+		std::size_t workers_number = 1;
+		ReplayPrecision replay_precision = ReplayPrecision::Float;
+		//checkpoints are saved in the background after the training step that makes checkpoint_steps training steps or
+		//checkpoint_seconds seconds since the previous one, without training nothing in a checkpoint changes, so there is
+		//no timer, 0 turns the corresponding trigger off, a checkpoint is always saved when Q is destroyed
+		std::size_t checkpoint_steps = 0;
+		float checkpoint_seconds = 0;
+		//the replay memory is kept in a mapped file next to the weights and is reopened by the next run,
+		//so that it may be larger than the available memory
+		bool replay_in_file = false;
+		//values of the target model are cached between its updates, this many values that are no longer valid
+		//are found again after every training step
+		std::size_t targets_refresh_number = 0;
+		//training runs on a separate thread, so that call_network only records transitions and chooses actions
+		//with the latest published copy of the local model
+		bool background_training = false;
+		//layers of the models report their forward and backward calls, see layer_profile
+		bool profile_layers = false;
+	};
+
+	//snapshot of counters kept since Q was created, they only grow, so rates over an interval are found
+	//from the difference of two snapshots, while percentiles over an interval are given by stats(since)
+	struct QStats
+	{
+		std::uint64_t actions = 0;
+		//percentiles of the time taken to choose an action, including the training step it may trigger, in microseconds
+		float action_latency_p50 = 0;
+		float action_latency_p99 = 0;
+		//counts of the buckets of the histogram the percentiles are found from
+		std::vector<std::uint64_t> action_latency_counts;
+		std::uint64_t transitions = 0;
+		std::uint64_t training_steps = 0;
+		//mean time of a training step on a minibatch, in milliseconds
+		float training_step_time = 0;
+		float batches_per_second = 0;
+		//grows while training stalls, negative if there has not been any training yet
+		float seconds_since_training = -1;
+		std::uint64_t target_updates = 0;
+		std::size_t replay_size = 0;
+		std::size_t replay_capacity = 0;
+		float mean_priority = 0;
+		float max_priority = 0;
+		float eps = 0;
+		float beta = 0;
 	};
 
 	class Q final
@@ -46,6 +102,15 @@ namespace dqn
 
 		int call_network_debug(float prev_reward, std::size_t actions_number);
 		int call_network_debug(float prev_reward);
+		//json with calls, time, estimated flops and bytes of every layer of the local, target and acting models,
+		//totals are given for every part of a model, nothing is counted unless profile_layers is set
+		std::string layer_profile() const;
+		void reset_layer_profile();
+		//does not wait for the training, so it may be called from any thread at any time
+		QStats stats() const;
+		//same as stats, but the percentiles of action latency are taken over the actions chosen after since
+		//was returned by stats of this Q
+		QStats stats(const QStats& since) const;
 	};
 }
 
@@ -0,0 +1,272 @@
+#include "dqn/BoardCodec.h"
+
+#include <xtl/xhalf_float.hpp>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+	//conversions between float and the stored value of a dense channel
+	struct FloatValue
+	{
+		using Stored = float;
+		static Stored store(float value) { return value; }
+		static float load(Stored stored) { return stored; }
+	};
+
+	struct HalfValue
+	{
+		using Stored = std::uint16_t;
+		static Stored store(float value) { return std::bit_cast<Stored>(xtl::half_float(value)); }
+		static float load(Stored stored) { return static_cast<float>(std::bit_cast<xtl::half_float>(stored)); }
+	};
+
+	//bfloat16 is the upper half of float, the lower half is rounded to nearest even
+	struct BFloat16Value
+	{
+		using Stored = std::uint16_t;
+		static Stored store(float value)
+		{
+			const std::uint32_t bits = std::bit_cast<std::uint32_t>(value);
+			return static_cast<Stored>((bits + 0x7FFF + ((bits >> 16) & 1)) >> 16);
+		}
+		static float load(Stored stored) { return std::bit_cast<float>(static_cast<std::uint32_t>(stored) << 16); }
+	};
+
+	//values are copied through memcpy since encoded boards are not aligned
+	//if every channel is dense the board is converted as a whole, otherwise cell by cell
+	template <class Value>
+	unsigned char* encode_dense(const float* board, std::size_t cells_number, std::size_t channels_number,
+		const std::vector<std::size_t>& dense_channels, unsigned char* destination)
+	{
+		typename Value::Stored stored;
+		if (dense_channels.size() == channels_number)
+		{
+			for (std::size_t i = 0; i < cells_number * channels_number; ++i)
+			{
+				stored = Value::store(board[i]);
+				std::memcpy(destination + i * sizeof(stored), &stored, sizeof(stored));
+			}
+			return destination + cells_number * channels_number * sizeof(stored);
+		}
+		for (std::size_t i = 0; i < cells_number; ++i)
+			for (const std::size_t channel : dense_channels)
+			{
+				stored = Value::store(board[i * channels_number + channel]);
+				std::memcpy(destination, &stored, sizeof(stored));
+				destination += sizeof(stored);
+			}
+		return destination;
+	}
+
+	template <class Value>
+	const unsigned char* decode_dense(const unsigned char* source, std::size_t cells_number, std::size_t channels_number,
+		const std::vector<std::size_t>& dense_channels, float* board)
+	{
+		typename Value::Stored stored;
+		if (dense_channels.size() == channels_number)
+		{
+			for (std::size_t i = 0; i < cells_number * channels_number; ++i)
+			{
+				std::memcpy(&stored, source + i * sizeof(stored), sizeof(stored));
+				board[i] = Value::load(stored);
+			}
+			return source + cells_number * channels_number * sizeof(stored);
+		}
+		for (std::size_t i = 0; i < cells_number; ++i)
+			for (const std::size_t channel : dense_channels)
+			{
+				std::memcpy(&stored, source, sizeof(stored));
+				board[i * channels_number + channel] = Value::load(stored);
+				source += sizeof(stored);
+			}
+		return source;
+	}
+
+	//cells of a channel are packed eight to a byte, the lowest bit is the first cell
+	void pack_plane(const float* board, std::size_t cells_number, std::size_t channels_number, std::size_t channel,
+		unsigned char* plane)
+	{
+		for (std::size_t byte = 0; byte * 8 < cells_number; ++byte)
+		{
+			const std::size_t cells = std::min<std::size_t>(8, cells_number - byte * 8);
+			const float* cell = board + byte * 8 * channels_number + channel;
+			unsigned int bits = 0;
+			for (std::size_t j = 0; j < cells; ++j)
+				bits |= static_cast<unsigned int>(cell[j * channels_number] != 0.0f) << j;
+			plane[byte] = static_cast<unsigned char>(bits);
+		}
+	}
+
+	//floats of the eight bits of every byte, the lowest bit first
+	const std::array<std::array<float, 8>, 256> bits_floats = [] {
+		std::array<std::array<float, 8>, 256> floats{};
+		for (std::size_t byte = 0; byte < floats.size(); ++byte)
+			for (std::size_t j = 0; j < 8; ++j)
+				floats[byte][j] = static_cast<float>((byte >> j) & 1);
+		return floats;
+	}();
+
+	//transposes a matrix of 8x8 bits, byte k of matrix is its row k, so bit j of byte k becomes bit k of byte j
+	std::uint64_t transpose_bits(std::uint64_t matrix)
+	{
+		std::uint64_t t = (matrix ^ (matrix >> 7)) & 0x00AA00AA00AA00AAull;
+		matrix ^= t ^ (t << 7);
+		t = (matrix ^ (matrix >> 14)) & 0x0000CCCC0000CCCCull;
+		matrix ^= t ^ (t << 14);
+		t = (matrix ^ (matrix >> 28)) & 0x00000000F0F0F0F0ull;
+		matrix ^= t ^ (t << 28);
+		return matrix;
+	}
+
+	//binary channels of a cell are unpacked together, so that a board is written cell after cell rather than
+	//plane after plane: bytes of up to eight planes at the same position are transposed into a byte per cell
+	//holding the bits of its channels, which is expanded to floats with a lookup, and if every channel is binary
+	//these floats are copied as a contiguous run of channels of the cell
+	void unpack_planes(const unsigned char* planes, std::size_t plane_size, std::size_t cells_number,
+		std::size_t channels_number, const std::vector<std::size_t>& binary_channels, float* board)
+	{
+		const std::size_t binary_number = binary_channels.size();
+		const bool all_binary = binary_number == channels_number;
+		for (std::size_t first = 0; first < binary_number; first += 8)
+		{
+			const std::size_t group = std::min<std::size_t>(8, binary_number - first);
+			const unsigned char* group_planes = planes + first * plane_size;
+			for (std::size_t byte = 0; byte < plane_size; ++byte)
+			{
+				std::uint64_t matrix = 0;
+				for (std::size_t k = 0; k < group; ++k)
+					matrix |= static_cast<std::uint64_t>(group_planes[k * plane_size + byte]) << (8 * k);
+				const std::uint64_t cells_bits = transpose_bits(matrix);
+				const std::size_t cells = std::min<std::size_t>(8, cells_number - byte * 8);
+				float* cell = board + byte * 8 * channels_number;
+				for (std::size_t j = 0; j < cells; ++j, cell += channels_number)
+				{
+					const float* floats = bits_floats[(cells_bits >> (8 * j)) & 0xFF].data();
+					if (all_binary)
+						std::copy_n(floats, group, cell + first);
+					else
+						for (std::size_t k = 0; k < group; ++k)
+							cell[binary_channels[first + k]] = floats[k];
+				}
+			}
+		}
+	}
+}
+
+dqn::BoardCodec::BoardCodec(ReplayPrecision precision, std::size_t cells_number, std::size_t channels_number) :
+	precision(precision), cells_number(cells_number), channels_number(channels_number)
+{
+	for (std::size_t channel = 0; channel < channels_number; ++channel)
+		binary_channels.push_back(channel);
+}
+
+dqn::BoardCodec::BoardCodec(ReplayPrecision precision, std::size_t cells_number, std::size_t channels_number,
+	const unsigned char* binary_flags) :
+	precision(precision), cells_number(cells_number), channels_number(channels_number)
+{
+	for (std::size_t channel = 0; channel < channels_number; ++channel)
+		(binary_flags[channel] ? binary_channels : dense_channels).push_back(channel);
+}
+
+void dqn::BoardCodec::store_binary_flags(unsigned char* binary_flags) const
+{
+	std::fill_n(binary_flags, channels_number, 0);
+	for (const std::size_t channel : binary_channels)
+		binary_flags[channel] = 1;
+}
+
+std::size_t dqn::BoardCodec::value_size() const
+{
+	return precision == ReplayPrecision::Float ? sizeof(float) : sizeof(std::uint16_t);
+}
+
+std::size_t dqn::BoardCodec::encoded_size() const
+{
+	return binary_channels.size() * plane_size() + dense_channels.size() * cells_number * value_size();
+}
+
+bool dqn::BoardCodec::is_binary(const float* board, std::size_t channel) const
+{
+	bool binary = true;
+	for (std::size_t i = 0; i < cells_number; ++i)
+	{
+		const float value = board[i * channels_number + channel];
+		binary &= value == 0.0f || value == 1.0f;
+	}
+	return binary;
+}
+
+bool dqn::BoardCodec::accepts(const float* boards, std::size_t boards_number) const
+{
+	for (std::size_t b = 0; b < boards_number; ++b)
+		for (const std::size_t channel : binary_channels)
+			if (!is_binary(boards + b * cells_number * channels_number, channel))
+				return false;
+	return true;
+}
+
+void dqn::BoardCodec::widen(const float* boards, std::size_t boards_number)
+{
+	const auto is_dense = [&](std::size_t channel) {
+		for (std::size_t b = 0; b < boards_number; ++b)
+			if (!is_binary(boards + b * cells_number * channels_number, channel))
+				return true;
+		return false;
+	};
+	const auto first_dense = std::stable_partition(binary_channels.begin(), binary_channels.end(),
+		[&](std::size_t channel) { return !is_dense(channel); });
+	dense_channels.insert(dense_channels.end(), first_dense, binary_channels.end());
+	binary_channels.erase(first_dense, binary_channels.end());
+	std::sort(dense_channels.begin(), dense_channels.end());
+}
+
+void dqn::BoardCodec::encode(const float* boards, std::size_t boards_number, unsigned char* destination) const
+{
+	for (std::size_t b = 0; b < boards_number; ++b)
+	{
+		const float* board = boards + b * cells_number * channels_number;
+		for (const std::size_t channel : binary_channels)
+		{
+			pack_plane(board, cells_number, channels_number, channel, destination);
+			destination += plane_size();
+		}
+		switch (precision)
+		{
+		case ReplayPrecision::Half:
+			destination = encode_dense<HalfValue>(board, cells_number, channels_number, dense_channels, destination);
+			break;
+		case ReplayPrecision::BFloat16:
+			destination = encode_dense<BFloat16Value>(board, cells_number, channels_number, dense_channels, destination);
+			break;
+		default:
+			destination = encode_dense<FloatValue>(board, cells_number, channels_number, dense_channels, destination);
+			break;
+		}
+	}
+}
+
+void dqn::BoardCodec::decode(const unsigned char* source, std::size_t boards_number, float* boards) const
+{
+	for (std::size_t b = 0; b < boards_number; ++b)
+	{
+		float* board = boards + b * cells_number * channels_number;
+		unpack_planes(source, plane_size(), cells_number, channels_number, binary_channels, board);
+		source += binary_channels.size() * plane_size();
+		switch (precision)
+		{
+		case ReplayPrecision::Half:
+			source = decode_dense<HalfValue>(source, cells_number, channels_number, dense_channels, board);
+			break;
+		case ReplayPrecision::BFloat16:
+			source = decode_dense<BFloat16Value>(source, cells_number, channels_number, dense_channels, board);
+			break;
+		default:
+			source = decode_dense<FloatValue>(source, cells_number, channels_number, dense_channels, board);
+			break;
+		}
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef DQN_BOARDCODEC_H
+#define DQN_BOARDCODEC_H
+
+#include "dqn/Q.h"
+
+#include <vector>
+#include <cstddef>
+
+namespace dqn
+{
+	//converts boards between float and the form in which they are kept in the replay memory
+	//channels holding only zeros and ones are packed to a bit per cell, other channels are kept in the given precision
+	//every channel starts as binary, a channel is widened once a board with other values in it arrives,
+	//after that boards encoded before have to be encoded again
+	class BoardCodec
+	{
+	private:
+		ReplayPrecision precision;
+		std::size_t cells_number;
+		std::size_t channels_number;
+		std::vector<std::size_t> binary_channels;
+		std::vector<std::size_t> dense_channels;
+
+		std::size_t plane_size() const { return (cells_number + 7) / 8; }
+		std::size_t value_size() const;
+		bool is_binary(const float* board, std::size_t channel) const;
+
+	public:
+		BoardCodec(ReplayPrecision precision, std::size_t cells_number, std::size_t channels_number);
+		//restores a codec from flags written by store_binary_flags
+		BoardCodec(ReplayPrecision precision, std::size_t cells_number, std::size_t channels_number,
+			const unsigned char* binary_flags);
+
+		//writes a flag for every channel, nonzero if the channel is binary
+		void store_binary_flags(unsigned char* binary_flags) const;
+
+		//number of bytes taken by a single encoded board
+		std::size_t encoded_size() const;
+		//checks that binary channels of the boards hold only zeros and ones
+		bool accepts(const float* boards, std::size_t boards_number) const;
+		//makes every channel that has other values than zeros and ones in the boards dense
+		void widen(const float* boards, std::size_t boards_number);
+		//boards must be accepted by the codec
+		void encode(const float* boards, std::size_t boards_number, unsigned char* destination) const;
+		void decode(const unsigned char* source, std::size_t boards_number, float* boards) const;
+	};
+}
+
+#endif
@@ -0,0 +1,155 @@
+#include "dqn/Checkpointer.h"
+#include "neural_network/model/WeightsFile.h"
+
+#include <nlohmann/json.hpp>
+#include <filesystem>
+#include <fstream>
+#include <cstdint>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const std::string temporary_suffix = ".tmp";
+
+	//flushes the file to the disk, so that renaming it over the previous checkpoint never leaves an empty file after
+	//a power loss
+	bool sync_file(const std::string& filename)
+	{
+#ifdef _WIN32
+		HANDLE file = CreateFileA(filename.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		const bool synced = FlushFileBuffers(file);
+		CloseHandle(file);
+		return synced;
+#else
+		const int file_descriptor = ::open(filename.c_str(), O_RDONLY);
+		if (file_descriptor == -1)
+			return false;
+		const bool synced = ::fsync(file_descriptor) == 0;
+		::close(file_descriptor);
+		return synced;
+#endif
+	}
+
+	//flushes the entries of the directory holding the file, so that a rename survives a power loss,
+	//Windows has no way to flush a directory, renames are left to its file system there
+	void sync_directory(const std::string& filename)
+	{
+#ifndef _WIN32
+		const std::string directory = std::filesystem::path(filename).parent_path().string();
+		const int directory_descriptor = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+		if (directory_descriptor == -1)
+			return;
+		::fsync(directory_descriptor);
+		::close(directory_descriptor);
+#endif
+	}
+
+	bool write_weights(const std::string& filename, const std::vector<xt::xarray<float>>& weights)
+	{
+		std::vector<const xt::xarray<float>*> tensors;
+		for (const auto& tensor : weights)
+			tensors.push_back(&tensor);
+		return nn::write_weights_file(filename, tensors) && sync_file(filename);
+	}
+
+	bool write_json(const std::string& filename, const nlohmann::json& json)
+	{
+		std::ofstream out_file(filename, std::ios::trunc);
+		out_file << json.dump();
+		out_file.close();
+		return out_file.good();
+	}
+}
+
+dqn::Checkpointer::Checkpointer(std::string common_part, std::uint64_t checkpoint_number) :
+	common_part(std::move(common_part)), parameters_filename(this->common_part + "_parameters.json"),
+	checkpoint_number(checkpoint_number), writer(&Checkpointer::work, this)
+{
+}
+
+std::string dqn::Checkpointer::weights_filename(const std::string& model_name, std::uint64_t number) const
+{
+	return common_part + "_" + model_name + "." + std::to_string(number) + ".weights";
+}
+
+dqn::Checkpointer::~Checkpointer()
+{
+	{
+		std::lock_guard<std::mutex> lg(mutex);
+		stopping = true;
+	}
+	checkpoint_submitted.notify_one();
+	writer.join();
+}
+
+void dqn::Checkpointer::submit(const std::function<void(Checkpoint&)>& fill)
+{
+	{
+		std::lock_guard<std::mutex> lg(mutex);
+		fill(pending);
+		has_pending = true;
+	}
+	checkpoint_submitted.notify_one();
+}
+
+void dqn::Checkpointer::work()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		checkpoint_submitted.wait(lock, [this] { return has_pending || stopping; });
+		if (!has_pending)
+			return;
+		std::swap(pending, writing);
+		has_pending = false;
+		lock.unlock();
+		write(writing);
+		lock.lock();
+	}
+}
+
+//weights files get the number of the new checkpoint, so they never overwrite the ones the parameters file names,
+//the writer has nobody to report to, so a failed checkpoint is simply replaced by the next one
+void dqn::Checkpointer::write(const Checkpoint& checkpoint)
+{
+	const std::uint64_t number = checkpoint_number + 1;
+	const std::string local_filename = weights_filename("local", number);
+	const std::string target_filename = weights_filename("target", number);
+	const nlohmann::json parameters = {
+		{"eps", checkpoint.eps},
+		{"beta", checkpoint.beta},
+		{"update_count", checkpoint.update_count},
+		{"checkpoint", number},
+		{"local_weights", std::filesystem::path(local_filename).filename().string()},
+		{"target_weights", std::filesystem::path(target_filename).filename().string()} };
+	std::error_code error;
+	bool written = write_weights(local_filename, checkpoint.local_weights) &&
+		write_weights(target_filename, checkpoint.target_weights) &&
+		write_json(parameters_filename + temporary_suffix, parameters) && sync_file(parameters_filename + temporary_suffix);
+	if (written)
+	{
+		std::filesystem::rename(parameters_filename + temporary_suffix, parameters_filename, error);
+		written = !error;
+	}
+	if (!written)
+	{
+		for (const std::string* filename : { &local_filename, &target_filename })
+			std::filesystem::remove(*filename, error);
+		std::filesystem::remove(parameters_filename + temporary_suffix, error);
+		return;
+	}
+	sync_directory(parameters_filename);
+	std::filesystem::remove(weights_filename("local", checkpoint_number), error);
+	std::filesystem::remove(weights_filename("target", checkpoint_number), error);
+	checkpoint_number = number;
+}
@@ -0,0 +1,66 @@
+#ifndef DQN_CHECKPOINTER_H
+#define DQN_CHECKPOINTER_H
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+#include <xtensor/containers/xarray.hpp>
+
+namespace dqn
+{
+	//everything that is saved between runs
+	struct Checkpoint
+	{
+		std::vector<xt::xarray<float>> local_weights;
+		std::vector<xt::xarray<float>> target_weights;
+		float eps = 0;
+		float beta = 0;
+		int update_count = 0;
+	};
+
+	//writes checkpoints on its own thread, so that the thread taking them never waits for the disk
+	//weights files are numbered by their checkpoint and the parameters file names them, the parameters file is written
+	//next to its final name and renamed over it, so that single rename commits the whole set: a crash or a failed write
+	//leaves the previous checkpoint in place, its weights files are removed only after the rename
+	class Checkpointer
+	{
+	private:
+		std::string common_part;
+		std::string parameters_filename;
+		//number of the last committed checkpoint, 0 if there is none
+		std::uint64_t checkpoint_number;
+
+		std::mutex mutex;
+		std::condition_variable checkpoint_submitted;
+		//the checkpoint is filled under the mutex and swapped with the one being written,
+		//so buffers are reused and only the latest checkpoint waits to be written
+		Checkpoint pending;
+		Checkpoint writing;
+		bool has_pending = false;
+		bool stopping = false;
+		//started last, when everything it uses is constructed
+		std::thread writer;
+
+		void work();
+		std::string weights_filename(const std::string& model_name, std::uint64_t number) const;
+		void write(const Checkpoint& checkpoint);
+
+	public:
+		//files are named common_part + "_parameters.json", common_part + "_local.<number>.weights" and
+		//common_part + "_target.<number>.weights", checkpoint_number is the number of the checkpoint already on the disk
+		Checkpointer(std::string common_part, std::uint64_t checkpoint_number);
+		//writes the last submitted checkpoint before returning
+		~Checkpointer();
+		Checkpointer(const Checkpointer&) = delete;
+		Checkpointer& operator=(const Checkpointer&) = delete;
+
+		//fill is called on the calling thread with the buffer of the next checkpoint, the checkpoint is written later
+		void submit(const std::function<void(Checkpoint&)>& fill);
+	};
+}
+
+#endif
@@ -0,0 +1,58 @@
+#include "dqn/LatencyHistogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <vector>
+
+//durations below sub_buckets_number have a bucket each, the rest are split by their highest bit and the bits after it
+std::size_t dqn::LatencyHistogram::bucket_of(std::uint64_t nanoseconds)
+{
+	if (nanoseconds < sub_buckets_number)
+		return nanoseconds;
+	const std::size_t highest_bit = std::bit_width(nanoseconds) - 1;
+	const std::size_t shift = highest_bit - sub_buckets_bits;
+	const std::size_t sub_bucket = (nanoseconds >> shift) & (sub_buckets_number - 1);
+	return (shift + 1) * sub_buckets_number + sub_bucket;
+}
+
+std::uint64_t dqn::LatencyHistogram::bucket_value(std::size_t bucket)
+{
+	if (bucket < sub_buckets_number)
+		return bucket;
+	const std::size_t shift = bucket / sub_buckets_number - 1;
+	const std::uint64_t lower = (sub_buckets_number + bucket % sub_buckets_number) << shift;
+	return lower + (std::uint64_t{ 1 } << shift) / 2;
+}
+
+void dqn::LatencyHistogram::record(std::uint64_t nanoseconds)
+{
+	buckets[bucket_of(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+}
+
+//every count is read once, so a record made in the meantime is either fully counted or not counted at all
+std::vector<std::uint64_t> dqn::LatencyHistogram::counts() const
+{
+	std::vector<std::uint64_t> counts(buckets_number);
+	for (std::size_t bucket = 0; bucket < buckets_number; ++bucket)
+		counts[bucket] = buckets[bucket].load(std::memory_order_relaxed);
+	return counts;
+}
+
+std::uint64_t dqn::LatencyHistogram::percentile(const std::vector<std::uint64_t>& counts, float fraction)
+{
+	std::uint64_t total = 0;
+	for (std::uint64_t count : counts)
+		total += count;
+	if (total == 0)
+		return 0;
+	const std::uint64_t rank = std::max<std::uint64_t>(1, (std::uint64_t)std::ceil(fraction * total));
+	std::uint64_t seen = 0;
+	for (std::size_t bucket = 0; bucket < counts.size(); ++bucket)
+	{
+		seen += counts[bucket];
+		if (seen >= rank)
+			return bucket_value(bucket);
+	}
+	return bucket_value(counts.size() - 1);
+}
@@ -0,0 +1,37 @@
+#ifndef DQN_LATENCYHISTOGRAM_H
+#define DQN_LATENCYHISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dqn
+{
+	//counts of durations in buckets that grow with the duration, so that percentiles are found with a relative error
+	//of at most 1/16 while recording is a single relaxed increment, it may be recorded and read from different threads
+	class LatencyHistogram
+	{
+	private:
+		//every power of two is split into this many buckets
+		static constexpr std::size_t sub_buckets_bits = 3;
+		static constexpr std::size_t sub_buckets_number = std::size_t{ 1 } << sub_buckets_bits;
+		static constexpr std::size_t buckets_number = (64 - sub_buckets_bits + 1) * sub_buckets_number;
+
+		std::array<std::atomic<std::uint64_t>, buckets_number> buckets{};
+
+		static std::size_t bucket_of(std::uint64_t nanoseconds);
+		//the middle of the range of durations that fall into the bucket
+		static std::uint64_t bucket_value(std::size_t bucket);
+
+	public:
+		void record(std::uint64_t nanoseconds);
+		//counts of all buckets, the difference of two reads holds the durations recorded in between
+		std::vector<std::uint64_t> counts() const;
+		//fraction is in [0, 1], 0 is returned if nothing has been counted
+		static std::uint64_t percentile(const std::vector<std::uint64_t>& counts, float fraction);
+	};
+}
+
+#endif
@@ -1,6 +1,5 @@
 #include "dqn/ModelDueling.h"
-#include "neural_network/layers/LayerConv2D.h"
-#include "neural_network/layers/LayerMaxPooling2D.h"
+#include "neural_network/layers/LayerConv2DMaxPooling2D.h"
 #include "neural_network/layers/LayerFlatten.h"
 #include "neural_network/layers/LayerDense.h"
 #include "neural_network/utils/ActivationFunctions.h"
@@ -12,40 +11,24 @@ using Axis = int;
 
 dqn::ModelDueling::ModelDueling()
 {
-	layers_parts[ConvStatePart] = {
-		.all_layers = &layers,
-		.part_begin = insert_into_layers(
-			std::make_unique<nn::LayerConv2D>(10, nn::KernelSize{ 3,3 }, nn::Padding::Valid, nn::Activation::Sigmoid),
-			std::make_unique<nn::LayerMaxPooling2D>(nn::PoolSize{ 2,2 }),
-			std::make_unique<nn::LayerConv2D>(20, nn::KernelSize{ 3,3 }, nn::Padding::Valid, nn::Activation::Sigmoid),
-			std::make_unique<nn::LayerMaxPooling2D>(nn::PoolSize{ 2,2 }),
-			std::make_unique<nn::LayerFlatten>() ) - layers.begin(),
-		.part_end = (std::ptrdiff_t)layers.size(),
-	};
-	layers_parts[ConvActionsPart] = {
-		.all_layers = &layers,
-		.part_begin = insert_into_layers(
-			std::make_unique<nn::LayerConv2D>(10, nn::KernelSize{ 3,3 }, nn::Padding::Valid, nn::Activation::Sigmoid),
-			std::make_unique<nn::LayerMaxPooling2D>(nn::PoolSize{ 2,2 }),
-			std::make_unique<nn::LayerConv2D>(20, nn::KernelSize{ 3,3 }, nn::Padding::Valid, nn::Activation::Sigmoid),
-			std::make_unique<nn::LayerMaxPooling2D>(nn::PoolSize{ 2,2 }),
-			std::make_unique<nn::LayerFlatten>() ) - layers.begin(),
-		.part_end = (std::ptrdiff_t)layers.size()
-	};
-	layers_parts[ValuePart] = {
-		.all_layers = &layers,
-		.part_begin = insert_into_layers(
-			std::make_unique<nn::LayerDense>(10, nn::Activation::Sigmoid),
-			std::make_unique<nn::LayerDense>(1, nn::Activation::Sigmoid) ) - layers.begin(),
-		.part_end = (std::ptrdiff_t)layers.size()
-	};
-	layers_parts[AdvantagePart] = {
-		.all_layers = &layers,
-		.part_begin = insert_into_layers(
-			std::make_unique<nn::LayerDense>(20, nn::Activation::Sigmoid),
-			std::make_unique<nn::LayerDense>(1, nn::Activation::Sigmoid) ) - layers.begin(),
-		.part_end = (std::ptrdiff_t)layers.size()
-	};
+	layers_parts[ConvStatePart] = make_layers_part(
+		std::make_unique<nn::LayerConv2DMaxPooling2D>(10, nn::KernelSize{ 3,3 }, nn::Padding::Valid, nn::Activation::Sigmoid,
+			nn::PoolSize{ 2,2 }),
+		std::make_unique<nn::LayerConv2DMaxPooling2D>(20, nn::KernelSize{ 3,3 }, nn::Padding::Valid, nn::Activation::Sigmoid,
+			nn::PoolSize{ 2,2 }),
+		std::make_unique<nn::LayerFlatten>());
+	layers_parts[ConvActionsPart] = make_layers_part(
+		std::make_unique<nn::LayerConv2DMaxPooling2D>(10, nn::KernelSize{ 3,3 }, nn::Padding::Valid, nn::Activation::Sigmoid,
+			nn::PoolSize{ 2,2 }),
+		std::make_unique<nn::LayerConv2DMaxPooling2D>(20, nn::KernelSize{ 3,3 }, nn::Padding::Valid, nn::Activation::Sigmoid,
+			nn::PoolSize{ 2,2 }),
+		std::make_unique<nn::LayerFlatten>());
+	layers_parts[ValuePart] = make_layers_part(
+		std::make_unique<nn::LayerDense>(10, nn::Activation::Sigmoid),
+		std::make_unique<nn::LayerDense>(1, nn::Activation::Sigmoid));
+	layers_parts[AdvantagePart] = make_layers_part(
+		std::make_unique<nn::LayerDense>(20, nn::Activation::Sigmoid),
+		std::make_unique<nn::LayerDense>(1, nn::Activation::Sigmoid));
 	for (auto& part : layers_parts)
 	{
 		part.part_rbegin = layers.size() - part.part_end;
@@ -70,6 +53,15 @@ void dqn::ModelDueling::build(std::vector<std::size_t> input_shape) const
 	}
 }
 
+std::string dqn::ModelDueling::layer_group(std::size_t layer_index) const
+{
+	static const std::array<std::string, PartsTotal> parts_groups = { "ConvState", "ConvActions", "Value", "Advantage" };
+	for (int part = ConvStatePart; part != PartsTotal; ++part)
+		if ((std::ptrdiff_t)layer_index >= layers_parts[part].part_begin && (std::ptrdiff_t)layer_index < layers_parts[part].part_end)
+			return parts_groups[part];
+	return ModelBase::layer_group(layer_index);
+}
+
 void dqn::ModelDueling::call_layers_part(LayersPartName layers_part_name, xt::xarray<float>& inputs, nn::Tape* tape) const
 {
 	for (const auto& layer : layers_parts[layers_part_name])
@@ -81,7 +73,7 @@ void dqn::ModelDueling::backward_layers_part(LayersPartName layers_part_name, xt
 {
 	auto& cur_layer_part = layers_parts[layers_part_name];
 	for (auto layer_it = cur_layer_part.rbegin(); layer_it != cur_layer_part.rend(); ++layer_it)
-		(*layer_it)->backward(deltas, outputs, tape, gradient_map);
+		(*layer_it)->backward(outputs, deltas, tape, gradient_map);
 }
 
 xt::xarray<float> dqn::ModelDueling::call_with_tape(std::array<xt::xarray<float>, 2>& inputs, nn::Tape* tape) const
@@ -121,8 +113,12 @@ void dqn::ModelDueling::backward(xt::xarray<float>& outputs, xt::xarray<float> d
 			//actions break point corresponds to state deltas size
 			std::size_t actions_break_point = state_deltas.shape()[Axis{ 1 }];
 			auto actions_deltas_half = xt::view(actions_deltas, xt::all(), xt::range(0, actions_break_point));
-			//extra axis is temporarily added to get rid of actions deltas batch size
-			state_deltas = xt::sum(xt::view(state_deltas, xt::all(), xt::newaxis()) + actions_deltas_half, { Axis{1} });
+			//the state is either paired with every action, as in training batches, or broadcast to all actions
+			if (state_deltas.shape()[Axis{ 0 }] == actions_deltas.shape()[Axis{ 0 }])
+				state_deltas += actions_deltas_half;
+			else
+				//extra axis is temporarily added to get rid of actions deltas batch size
+				state_deltas = xt::sum(xt::view(state_deltas, xt::all(), xt::newaxis()) + actions_deltas_half, { Axis{1} });
 			actions_deltas = xt::view(actions_deltas, xt::all(), xt::range(actions_break_point, _));
 			//the same must be done for outputs
 			auto& action_outputs = branch_outputs[ActionsBranch];
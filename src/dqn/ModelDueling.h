@@ -51,6 +51,16 @@ namespace dqn
 			std::array{ValuePart, AdvantagePart}
 		};
 
+		//layers must be inserted before the part offsets are taken, since the insertion may reallocate the layers vector
+		//reverse offsets depend on the size of the whole vector, so they are set once all parts are inserted
+		template<typename... Args>
+		layers_part make_layers_part(Args&&... args)
+		{
+			const auto part_begin = insert_into_layers(std::forward<Args>(args)...);
+			return { .all_layers = &layers, .part_begin = part_begin - layers.begin(), .part_end = (std::ptrdiff_t)layers.size(),
+				.part_rbegin = 0, .part_rend = 0 };
+		}
+
 		void call_layers_part(LayersPartName layers_part_name, xt::xarray<float>& inputs, nn::Tape* tape) const;
 		void backward_layers_part(LayersPartName layers_part_name, xt::xarray<float>& outputs, xt::xarray<float>& deltas,
 			nn::Tape& tape, nn::GradientMap& gradient_map) const;
@@ -59,6 +69,9 @@ namespace dqn
 		virtual void backward(xt::xarray<float>& outputs, xt::xarray<float> deltas, nn::Tape& tape,
 			nn::GradientMap& gradient_map) const override;
 
+	protected:
+		virtual std::string layer_group(std::size_t layer_index) const override;
+
 	public:
 		ModelDueling();
 		virtual void build(std::vector<std::size_t> input_shape) const override;
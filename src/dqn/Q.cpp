@@ -1,45 +1,42 @@
 #include "dqn/Q.h"
 #include "dqn/ModelDueling.h"
+#include "dqn/ThreadPool.h"
+#include "dqn/SumTree.h"
+#include "dqn/ReplayMemory.h"
+#include "dqn/Checkpointer.h"
+#include "dqn/LatencyHistogram.h"
+#include "neural_network/utils/Profiler.h"
 
-#include <xtensor/views/xindex_view.hpp>
 #include <xtensor/misc/xsort.hpp>
 #include <xtensor/generators/xrandom.hpp>
 #include <filesystem>
 #include <nlohmann/json.hpp>
 #include <fstream>
+#include <sstream>
 #include <ctime>
+#include <chrono>
 #include <array>
-#include <algorithm>
-
-#define USE_MULTITHREADING_IN_Q 1
-#if USE_MULTITHREADING_IN_Q
+#include <cstdint>
+#include <atomic>
 #include <mutex>
+#include <condition_variable>
 #include <thread>
-#endif
+#include <algorithm>
 
 #define TO_SCALAR at(0)
 
 using Axis = int;
 
+//the state and the actions are kept in the replay memory as a step
 struct PreviousStateAction
 {
-	xt::xarray<float> state;
-	xt::xarray<float> action;
+	std::size_t step = 0;
+	std::size_t action_index = 0;
 	bool empty = true;
 
 	PreviousStateAction() = default;
-	PreviousStateAction(xt::xarray<float> state, xt::xarray<float> action) : 
-		empty(false), state(state), action(action) { }
-};
-
-struct Transition
-{
-	xt::xarray<float> state;
-	xt::xarray<float> action;
-	float reward;
-	xt::xarray<float> afterstate;
-	xt::xarray<float> possible_actions;
-	bool done;
+	PreviousStateAction(std::size_t step, std::size_t action_index) :
+		empty(false), step(step), action_index(action_index) { }
 };
 
 struct Best
@@ -52,6 +49,20 @@ struct Batch
 {
 	xt::xarray<std::size_t> index_batch;
 	xt::xarray<float> importance_weights;
+	//generations of the drawn slots, a slot that changed its generation holds another transition
+	std::vector<std::uint64_t> generations;
+};
+
+//largest values of the target model for afterstates of the given transitions, inputs are only copied
+//for values that are not cached
+struct TargetEvaluation
+{
+	std::vector<std::size_t> indices;
+	std::vector<std::uint64_t> generations;
+	std::vector<float> values;
+	std::vector<std::size_t> missing;
+	std::vector<xt::xarray<float>> afterstates;
+	std::vector<xt::xarray<float>> possible_actions;
 };
 
 class dqn::Q::QPrivate final
@@ -62,31 +73,88 @@ private:
 
 	const QParameters parameters;
 
-	std::string model_local_filename;
-	std::string model_target_filename;
+	//weights in json are only imported
+	std::string model_local_json_filename;
+	std::string model_target_json_filename;
 	std::string parameters_filename;
-	float eps = parameters.max_eps;
-	float beta = parameters.beta_min;
+	std::atomic<float> eps = parameters.max_eps;
+	std::atomic<float> beta = parameters.beta_min;
 	int update_count = parameters.update_target;
 	int train_count = parameters.train_local;
 
+	//declared before the models, since their layers report to it
+	nn::Profiler profiler;
 	ModelDueling model_local;
 	ModelDueling model_target;
-	std::vector<Transition> trace;
-	std::vector<float> priorities;
-
-#if USE_MULTITHREADING_IN_Q
-	std::mutex vars_change_mutex;
-#endif
-
-	void load();
+	ReplayMemory trace;
+	SumTree priorities{ parameters.max_trace };
+	mutable ThreadPool thread_pool{ parameters.workers_number };
+	std::unique_ptr<Checkpointer> checkpointer;
+	std::size_t steps_since_checkpoint = 0;
+	std::chrono::steady_clock::time_point last_checkpoint_time = std::chrono::steady_clock::now();
+	//the largest value of the target model for the afterstate of every transition, it is valid while its version
+	//equals target_version, which changes whenever the target model does, version 0 is never valid
+	std::vector<float> target_values = std::vector<float>(parameters.max_trace);
+	std::vector<std::uint64_t> target_versions = std::vector<std::uint64_t>(parameters.max_trace);
+	std::uint64_t target_version = 1;
+	std::size_t refresh_cursor = 0;
+	//changes every time a transition is written into the slot
+	std::vector<std::uint64_t> slot_generations = std::vector<std::uint64_t>(parameters.max_trace);
+	//batches are drawn with their own engine, since the default one is used by the acting thread
+	xt::random::default_engine_type batch_engine{ xt::random::get_default_random_engine()() };
+	//every part of the minibatch writes its gradient into its own slot, slots are kept between trainings
+	std::vector<xt::xarray<xt::xarray<float>>> part_gradients;
+
+	//in background training the replay memory with priorities and cached target values is shared with the learner,
+	//which trains the local model and publishes its copy for choosing actions after every training step,
+	//a copy that was replaced is reused once the acting thread no longer holds it,
+	//the mutex of the published copy is only held while the pointer is copied
+	std::mutex replay_mutex;
+	std::condition_variable transitions_added;
+	std::size_t new_transitions = 0;
+	bool stop_learner = false;
+	mutable std::mutex acting_model_mutex;
+	std::shared_ptr<ModelDueling> acting_model;
+	std::shared_ptr<ModelDueling> spare_model;
+	std::thread learner;
+
+	//counters of stats, they are written with relaxed atomics and are only read in stats
+	const std::chrono::steady_clock::time_point creation_time = std::chrono::steady_clock::now();
+	LatencyHistogram action_latencies;
+	std::atomic<std::uint64_t> actions_count = 0;
+	std::atomic<std::uint64_t> transitions_count = 0;
+	std::atomic<std::uint64_t> training_steps_count = 0;
+	std::atomic<std::uint64_t> training_nanoseconds = 0;
+	//since creation_time, 0 until the first training step
+	std::atomic<std::uint64_t> last_training_nanoseconds = 0;
+	std::atomic<std::uint64_t> target_updates_count = 0;
+	std::atomic<std::size_t> replay_size = 0;
+	std::atomic<float> mean_priority = 0;
+	std::atomic<float> highest_priority = 0;
+
+	std::uint64_t load();
+	bool load_weights(const nlohmann::json& parameters);
 	void save() const;
+	void save_if_due();
 	Best find_best(const xt::xarray<float>& state, const xt::xarray<float>& actions, const ModelDueling& model) const;
-	Batch get_batch() const;
+	Batch get_batch();
+	TargetEvaluation prepare_targets(std::vector<std::size_t> indices) const;
+	void evaluate_targets(TargetEvaluation& evaluation) const;
+	void store_target_values(const TargetEvaluation& evaluation);
+	void refresh_target_values();
+	void train_step();
 	void train_model();
-	void accumulate_vars_change(xt::xarray<xt::xarray<float>>& vars_change, std::size_t trace_index, float importance_weight);
+	void train_part(const Batch& batch, const std::vector<float>& targets, const xt::xarray<float>& states,
+		const xt::xarray<float>& actions, std::size_t part_begin, std::size_t part_end, std::vector<float>& new_priorities,
+		xt::xarray<xt::xarray<float>>& gradient);
 	void global_update();
-	void add_new_priority();
+	void publish_acting_model();
+	void learn();
+	void add_new_priority(std::size_t index);
+	void set_priority(std::size_t index, float priority);
+	void store_priority_stats();
+	static std::string common_filename(std::size_t field_height, std::size_t field_width, const std::string& player_id,
+		const std::string& filepath);
 
 	std::size_t inputs_number(const xt::xarray<float>& inputs) const
 	{
@@ -100,6 +168,15 @@ private:
 public:
 	~QPrivate()
 	{
+		if (learner.joinable())
+		{
+			{
+				const std::lock_guard lock(replay_mutex);
+				stop_learner = true;
+			}
+			transitions_added.notify_one();
+			learner.join();
+		}
 		save();
 	}
 
@@ -109,7 +186,12 @@ public:
 	QPrivate(std::size_t field_height, std::size_t field_width, std::size_t channels_number,
 		const std::string player_id, const std::string filepath, const QParameters& parameters_to_set);
 	std::size_t get_act(float prev_reward, const xt::xarray<float>& state, const xt::xarray<float>& actions);
-	void update(float reward, const xt::xarray<float>& afterstate, const xt::xarray<float>& possible_actions, bool done);
+	void update(float reward, bool done);
+	void end_episode(float reward);
+	void soft_reset();
+	std::string layer_profile() const;
+	void reset_layer_profile();
+	QStats stats(const QStats* since) const;
 
 	std::size_t random_number(std::size_t lower, std::size_t upper) const
 	{
@@ -128,7 +210,7 @@ dqn::Q::~Q() = default;
 
 void dqn::Q::soft_reset()
 {
-	QP->prev_record = PreviousStateAction();
+	QP->soft_reset();
 }
 
 int dqn::Q::call_network(float prev_reward, const std::vector<float>& state, const std::vector<float>& actions,
@@ -145,7 +227,7 @@ int dqn::Q::call_network(float prev_reward, const std::vector<float>& state, con
 	}
 	else
 	{
-		QP->update(prev_reward, adapted_state, adapted_actions, true);
+		QP->end_episode(prev_reward);
 		return -1;
 	}
 }
@@ -163,7 +245,7 @@ int dqn::Q::call_network_debug(float prev_reward, std::size_t actions_number)
 	}
 	else
 	{
-		QP->update(prev_reward, state, actions, true);
+		QP->end_episode(prev_reward);
 		return -1;
 	}
 }
@@ -173,53 +255,203 @@ int dqn::Q::call_network_debug(float prev_reward)
 	return call_network_debug(prev_reward, QP->random_number(lower_debug, upper_debug));
 }
 
+std::string dqn::Q::layer_profile() const
+{
+	return QP->layer_profile();
+}
+
+void dqn::Q::reset_layer_profile()
+{
+	QP->reset_layer_profile();
+}
+
+dqn::QStats dqn::Q::stats() const
+{
+	return QP->stats(nullptr);
+}
+
+dqn::QStats dqn::Q::stats(const QStats& since) const
+{
+	return QP->stats(&since);
+}
+
 dqn::Q::QPrivate::QPrivate(std::size_t field_height, std::size_t field_width, std::size_t channels_number,
 	const std::string player_id, const std::string filepath, const QParameters& parameters_to_set) :
-	parameters(parameters_to_set), shape{ 1, field_height, field_width, channels_number }
+	parameters(parameters_to_set), trace(parameters_to_set.max_trace, field_height * field_width, channels_number,
+		parameters_to_set.replay_precision, parameters_to_set.replay_in_file ?
+		common_filename(field_height, field_width, player_id, filepath) + "_replay.bin" : std::string()),
+	shape{ 1, field_height, field_width, channels_number }
 {
-	trace.reserve(parameters.max_trace);
-	priorities.reserve(parameters.max_trace);
 	std::vector<std::size_t> shape_for_build{ shape.begin(), shape.end() };
 	model_local.build(shape_for_build);
 	model_target.build(shape_for_build);
-	const std::string common_part = filepath + std::string("qdb") + std::to_string(field_height) + std::string("x") +
-		std::to_string(field_width) + std::string("_") + player_id;
-	model_local_filename = common_part + "_local.json";
-	model_target_filename = common_part + "_target.json";
+	const std::string common_part = common_filename(field_height, field_width, player_id, filepath);
+	model_local_json_filename = common_part + "_local.json";
+	model_target_json_filename = common_part + "_target.json";
 	parameters_filename = common_part + "_parameters.json";
-	load();
+	//a reopened replay memory brings its priorities with it
+	for (std::size_t index = 0; index < trace.size(); ++index)
+		priorities.set(index, trace.priority(index));
+	replay_size = trace.size();
+	store_priority_stats();
+	checkpointer = std::make_unique<Checkpointer>(common_part, load());
+	if (parameters.background_training)
+	{
+		//layers are initialised with the default random engine, so models are only built here
+		acting_model = std::make_shared<ModelDueling>();
+		spare_model = std::make_shared<ModelDueling>();
+		acting_model->build(shape_for_build);
+		spare_model->build(shape_for_build);
+		publish_acting_model();
+	}
+	//both copies of the published model share their entries, so acting is reported once whichever copy is published
+	if (parameters.profile_layers)
+	{
+		model_local.attach_profiler(profiler, "local/");
+		model_target.attach_profiler(profiler, "target/");
+		if (parameters.background_training)
+		{
+			acting_model->attach_profiler(profiler, "acting/");
+			spare_model->attach_profiler(profiler, "acting/");
+		}
+	}
+	if (parameters.background_training)
+		learner = std::thread(&QPrivate::learn, this);
+}
+
+std::string dqn::Q::QPrivate::layer_profile() const
+{
+	std::ostringstream out;
+	profiler.dump(out);
+	return out.str();
 }
 
+void dqn::Q::QPrivate::reset_layer_profile()
+{
+	profiler.reset();
+}
+
+//percentiles are found from the counts recorded after since, the returned counts are still cumulative
+dqn::QStats dqn::Q::QPrivate::stats(const QStats* since) const
+{
+	constexpr float nanoseconds_in_microsecond = 1e3f;
+	constexpr float nanoseconds_in_millisecond = 1e6f;
+	constexpr float nanoseconds_in_second = 1e9f;
+	const std::uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - creation_time).count();
+	QStats snapshot;
+	snapshot.actions = actions_count.load(std::memory_order_relaxed);
+	snapshot.action_latency_counts = action_latencies.counts();
+	std::vector<std::uint64_t> window = snapshot.action_latency_counts;
+	if (since && since->action_latency_counts.size() == window.size())
+		for (std::size_t bucket = 0; bucket < window.size(); ++bucket)
+			window[bucket] -= std::min(window[bucket], since->action_latency_counts[bucket]);
+	snapshot.action_latency_p50 = LatencyHistogram::percentile(window, 0.5f) / nanoseconds_in_microsecond;
+	snapshot.action_latency_p99 = LatencyHistogram::percentile(window, 0.99f) / nanoseconds_in_microsecond;
+	snapshot.transitions = transitions_count.load(std::memory_order_relaxed);
+	snapshot.training_steps = training_steps_count.load(std::memory_order_relaxed);
+	if (snapshot.training_steps > 0)
+	{
+		snapshot.training_step_time =
+			training_nanoseconds.load(std::memory_order_relaxed) / nanoseconds_in_millisecond / snapshot.training_steps;
+		snapshot.batches_per_second = snapshot.training_steps / (now / nanoseconds_in_second);
+		snapshot.seconds_since_training = (now - last_training_nanoseconds.load(std::memory_order_relaxed)) /
+			nanoseconds_in_second;
+	}
+	snapshot.target_updates = target_updates_count.load(std::memory_order_relaxed);
+	snapshot.replay_size = replay_size.load(std::memory_order_relaxed);
+	snapshot.replay_capacity = parameters.max_trace;
+	snapshot.mean_priority = mean_priority.load(std::memory_order_relaxed);
+	snapshot.max_priority = highest_priority.load(std::memory_order_relaxed);
+	snapshot.eps = eps.load(std::memory_order_relaxed);
+	snapshot.beta = beta.load(std::memory_order_relaxed);
+	return snapshot;
+}
+
+std::string dqn::Q::QPrivate::common_filename(std::size_t field_height, std::size_t field_width,
+	const std::string& player_id, const std::string& filepath)
+{
+	return filepath + std::string("qdb") + std::to_string(field_height) + std::string("x") +
+		std::to_string(field_width) + std::string("_") + player_id;
+}
+
+//only copying into the buffer of the checkpointer happens here, files are written on its thread
 void dqn::Q::QPrivate::save() const
 {
-	model_local.save_weights(model_local_filename);
-	model_target.save_weights(model_target_filename);
-	const nlohmann::json parameters = {
-		{"eps", eps},
-		{"beta", beta},
-		{"update_count", update_count} };
-	std::ofstream out_file(parameters_filename);
-	out_file << parameters.dump();
-	out_file.close();
+	const auto copy_weights = [](const ModelDueling& model, std::vector<xt::xarray<float>>& weights) {
+		const nn::TrainableVars trainable_vars = model.get_trainable_vars_fixed();
+		weights.resize(trainable_vars.size());
+		for (std::size_t i = 0; i < trainable_vars.size(); ++i)
+			weights[i] = *trainable_vars[i];
+	};
+	checkpointer->submit([&](Checkpoint& checkpoint) {
+		copy_weights(model_local, checkpoint.local_weights);
+		copy_weights(model_target, checkpoint.target_weights);
+		checkpoint.eps = eps;
+		checkpoint.beta = beta;
+		checkpoint.update_count = update_count;
+	});
+}
+
+//everything a checkpoint holds changes only in training steps, so both triggers are checked here
+void dqn::Q::QPrivate::save_if_due()
+{
+	steps_since_checkpoint++;
+	const auto now = std::chrono::steady_clock::now();
+	const bool steps_due = parameters.checkpoint_steps > 0 && steps_since_checkpoint >= parameters.checkpoint_steps;
+	const bool time_due = parameters.checkpoint_seconds > 0 &&
+		std::chrono::duration<float>(now - last_checkpoint_time).count() >= parameters.checkpoint_seconds;
+	if (!steps_due && !time_due)
+		return;
+	save();
+	steps_since_checkpoint = 0;
+	last_checkpoint_time = now;
 }
 
-void dqn::Q::QPrivate::load()
+//returns the number of the checkpoint on the disk, so that the next one is numbered after it
+std::uint64_t dqn::Q::QPrivate::load()
 {
-	if (std::filesystem::exists(model_local_filename) && std::filesystem::exists(model_local_filename) 
-		&& std::filesystem::exists(parameters_filename))
+	nlohmann::json parameters;
+	if (std::filesystem::exists(parameters_filename))
 	{
-		model_local.load_weights(model_local_filename);
-		model_target.load_weights(model_target_filename);
-		nlohmann::json parameters;
 		std::ifstream in_file(parameters_filename);
 		in_file >> parameters;
 		in_file.close();
-		eps = parameters["eps"];
+	}
+	if (!parameters.is_object())
+	{
+		global_update();
+		return 0;
+	}
+	if (load_weights(parameters))
+	{
+		eps = parameters["eps"].get<float>();
 		beta = parameters["beta"];
 		update_count = parameters["update_count"];
 	}
 	else
 		global_update();
+	return parameters.value("checkpoint", std::uint64_t(0));
+}
+
+//binary weights named by the parameters file are preferred, json weights are imported if there are no binary ones
+//matching the models, both binary files are checked before either model is changed,
+//so the models never get weights from different sources
+bool dqn::Q::QPrivate::load_weights(const nlohmann::json& parameters)
+{
+	const std::filesystem::path directory = std::filesystem::path(parameters_filename).parent_path();
+	if (parameters.contains("local_weights") && parameters.contains("target_weights"))
+	{
+		const std::string local_filename = (directory / parameters["local_weights"].get<std::string>()).string();
+		const std::string target_filename = (directory / parameters["target_weights"].get<std::string>()).string();
+		if (model_local.check_weights_binary(local_filename) && model_target.check_weights_binary(target_filename))
+			return model_local.load_weights_binary(local_filename) && model_target.load_weights_binary(target_filename);
+	}
+	if (!std::filesystem::exists(model_local_json_filename) || !std::filesystem::exists(model_target_json_filename))
+		return false;
+	model_local.load_weights(model_local_json_filename);
+	model_target.load_weights(model_target_json_filename);
+	return true;
 }
 
 Best dqn::Q::QPrivate::find_best(const xt::xarray<float>& state, const xt::xarray<float>& actions, const ModelDueling& model) const
@@ -232,93 +464,271 @@ Best dqn::Q::QPrivate::find_best(const xt::xarray<float>& state, const xt::xarra
 
 std::size_t dqn::Q::QPrivate::get_act(float prev_reward, const xt::xarray<float>& state, const xt::xarray<float>& actions)
 {
+	const auto start = std::chrono::steady_clock::now();
+	//the step is the afterstate and the possible actions of the previous transition
+	std::size_t step;
+	{
+		const std::lock_guard lock(replay_mutex);
+		step = trace.add_step(state.data(), actions.data(), inputs_number(actions));
+	}
 	if (!prev_record.empty)
-		update(prev_reward, state, actions, false);
-	const std::size_t act_index = random_float() < eps ?
-		random_number(0, inputs_number(actions)) : find_best(state, actions, model_local).index;
-	prev_record = { state, xt::view(actions, xt::range(act_index, act_index + 1)) };
+		update(prev_reward, false);
+	std::size_t act_index;
+	if (random_float() < eps)
+		act_index = random_number(0, inputs_number(actions));
+	else if (parameters.background_training)
+	{
+		std::shared_ptr<const ModelDueling> model;
+		{
+			const std::lock_guard lock(acting_model_mutex);
+			model = acting_model;
+		}
+		act_index = find_best(state, actions, *model).index;
+	}
+	else
+		act_index = find_best(state, actions, model_local).index;
+	prev_record = { step, act_index };
+	action_latencies.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - start).count());
+	actions_count.fetch_add(1, std::memory_order_relaxed);
 	return act_index;
 }
 
-Batch dqn::Q::QPrivate::get_batch() const
+//the terminal transition closes the episode, so the first action of the next one has no previous record
+void dqn::Q::QPrivate::end_episode(float reward)
+{
+	if (prev_record.empty)
+		return;
+	update(reward, true);
+	prev_record = PreviousStateAction();
+}
+
+void dqn::Q::QPrivate::soft_reset()
+{
+	if (!prev_record.empty)
+	{
+		const std::lock_guard lock(replay_mutex);
+		trace.discard_step(prev_record.step);
+	}
+	prev_record = PreviousStateAction();
+}
+
+//transitions are drawn without replacement: a drawn transition is removed from the tree until the batch is complete,
+//so the batch is never larger than the replay memory, min_trace may be below batch_size
+Batch dqn::Q::QPrivate::get_batch()
 {
-	auto adapted_priorities = xt::adapt(priorities);
-	auto index_batch = xt::random::choice(xt::arange(trace.size()), parameters.batch_size, adapted_priorities, false);
-	auto inter_res = xt::index_view(adapted_priorities, index_batch) / xt::sum(adapted_priorities) * trace.size();
-	auto importance_weights = xt::pow(inter_res, -beta) / xt::amax(inter_res);
-	return { index_batch, importance_weights };
+	const std::size_t batch_size = std::min(parameters.batch_size, trace.size());
+	//weights are normalised by the largest one, which belongs to the transition with the lowest priority
+	const float lowest_priority = priorities.min();
+	const xt::xarray<float> random_floats = xt::random::rand<float>({ batch_size }, 0.0f, 1.0f, batch_engine);
+	Batch batch{ xt::xarray<std::size_t>::from_shape({ batch_size }), xt::xarray<float>::from_shape({ batch_size }),
+		std::vector<std::uint64_t>(batch_size) };
+	std::vector<float> drawn_priorities(batch_size);
+	for (std::size_t i = 0; i < batch_size; ++i)
+	{
+		const std::size_t index = priorities.find(random_floats(i) * priorities.total());
+		drawn_priorities[i] = priorities.get(index);
+		batch.index_batch(i) = index;
+		batch.generations[i] = slot_generations[index];
+		batch.importance_weights(i) = std::pow(drawn_priorities[i] / lowest_priority, -beta);
+		priorities.remove(index);
+	}
+	for (std::size_t i = 0; i < batch_size; ++i)
+		priorities.set(batch.index_batch(i), drawn_priorities[i]);
+	return batch;
 }
 
+//the target model only changes in global_update, so its value for a transition is found once between updates,
+//the replay memory must be locked
+TargetEvaluation dqn::Q::QPrivate::prepare_targets(std::vector<std::size_t> indices) const
+{
+	TargetEvaluation evaluation;
+	evaluation.indices = std::move(indices);
+	evaluation.values.resize(evaluation.indices.size());
+	for (std::size_t i = 0; i < evaluation.indices.size(); ++i)
+	{
+		const std::size_t index = evaluation.indices[i];
+		evaluation.generations.push_back(slot_generations[index]);
+		if (target_versions[index] == target_version)
+		{
+			evaluation.values[i] = target_values[index];
+			continue;
+		}
+		auto afterstate = xt::xarray<float>::from_shape(shape);
+		std::array actions_shape = shape;
+		actions_shape[Axis{ 0 }] = trace.actions_number(index);
+		auto possible_actions = xt::xarray<float>::from_shape(actions_shape);
+		trace.copy_afterstate(index, afterstate.data());
+		trace.copy_possible_actions(index, possible_actions.data());
+		evaluation.missing.push_back(i);
+		evaluation.afterstates.push_back(std::move(afterstate));
+		evaluation.possible_actions.push_back(std::move(possible_actions));
+	}
+	return evaluation;
+}
+
+//every transition has its own set of possible actions, so values are found by a separate call per transition
+void dqn::Q::QPrivate::evaluate_targets(TargetEvaluation& evaluation) const
+{
+	thread_pool.parallel_for(evaluation.missing.size(), [&](std::size_t i, std::size_t) {
+		evaluation.values[evaluation.missing[i]] =
+			xt::amax(model_target.call({ evaluation.afterstates[i], evaluation.possible_actions[i] }))();
+	});
+}
+
+//a value is not cached if its transition was overwritten while it was found, the replay memory must be locked
+void dqn::Q::QPrivate::store_target_values(const TargetEvaluation& evaluation)
+{
+	for (const std::size_t i : evaluation.missing)
+	{
+		const std::size_t index = evaluation.indices[i];
+		if (slot_generations[index] != evaluation.generations[i])
+			continue;
+		target_values[index] = evaluation.values[i];
+		target_versions[index] = target_version;
+	}
+}
+
+//the replay memory is locked while the batch is drawn and copied and while the results are stored,
+//the models are only used by the thread that trains
 void dqn::Q::QPrivate::train_model()
 {
-	const auto [index_batch, importance_weights] = get_batch();
+	const auto start = std::chrono::steady_clock::now();
+	std::unique_lock lock(replay_mutex);
+	const Batch batch = get_batch();
+	const std::size_t batch_size = batch.index_batch.size();
+	//sampled states and actions are stacked along the batch axis, every state is paired with its own action
+	std::array batch_shape = shape;
+	batch_shape[Axis{ 0 }] = batch_size;
+	auto states = xt::xarray<float>::from_shape(batch_shape);
+	auto actions = xt::xarray<float>::from_shape(batch_shape);
+	trace.gather(batch.index_batch.data(), batch_size, states.data(), actions.data());
+	std::vector<float> targets(batch_size);
+	std::vector<std::size_t> afterstate_indices;
+	for (std::size_t i = 0; i < batch_size; ++i)
+	{
+		targets[i] = trace.reward(batch.index_batch(i));
+		if (!trace.done(batch.index_batch(i)))
+			afterstate_indices.push_back(batch.index_batch(i));
+	}
+	TargetEvaluation evaluation = prepare_targets(afterstate_indices);
+	lock.unlock();
+	evaluate_targets(evaluation);
+	for (std::size_t i = 0, k = 0; i < batch_size; ++i)
+		if (k < afterstate_indices.size() && afterstate_indices[k] == batch.index_batch(i))
+			targets[i] += parameters.gamma * evaluation.values[k++];
+
+	//the minibatch is split into contiguous parts, one per worker, and every part has its own forward and backward
+	const std::size_t parts_number = std::min(thread_pool.workers_number(), batch_size);
+	part_gradients.resize(parts_number);
+	std::vector<float> new_priorities(batch_size);
+	thread_pool.parallel_for(parts_number, [&](std::size_t part, std::size_t) {
+		train_part(batch, targets, states, actions, part * batch_size / parts_number, (part + 1) * batch_size / parts_number,
+			new_priorities, part_gradients[part]);
+	});
+	//nodes of the tree are shared between transitions, so priorities are updated after the parts are done,
+	//a transition that was overwritten in the meantime keeps the priority given to it as a new one
+	lock.lock();
+	for (std::size_t i = 0; i < batch_size; ++i)
+		if (slot_generations[batch.index_batch(i)] == batch.generations[i])
+			set_priority(batch.index_batch(i), new_priorities[i]);
+	store_target_values(evaluation);
+	store_priority_stats();
+	lock.unlock();
+	//gradients of the parts are reduced parameter by parameter, always in the same order
 	const nn::TrainableVars trainable_vars = model_local.get_trainable_vars();
-	xt::xarray<xt::xarray<float>> vars_change;
-#if USE_MULTITHREADING_IN_Q
-	std::vector<std::thread> threads;
-#endif
-	for (std::size_t i = 0; i < parameters.batch_size; ++i)
-#if !USE_MULTITHREADING_IN_Q
-		accumulate_vars_change(vars_change, index_batch(i), importance_weights(i));
-#else
-		threads.push_back(std::thread(&QPrivate::accumulate_vars_change, this, 
-			std::ref(vars_change), index_batch(i), importance_weights(i)));
-	for (auto& thread : threads)
-		thread.join();
-#endif
-	for (std::size_t k = 0; k < trainable_vars.size(); ++k)
-		*trainable_vars[k] += vars_change(k);
-}
-
-void dqn::Q::QPrivate::accumulate_vars_change(xt::xarray<xt::xarray<float>>& vars_change, 
-	std::size_t trace_index, float importance_weight)
-{
-	const Transition& transition = trace[trace_index];
+	thread_pool.parallel_for(trainable_vars.size(), [&](std::size_t k, std::size_t) {
+		auto& vars_change = part_gradients[0](k);
+		for (std::size_t part = 1; part < parts_number; ++part)
+			vars_change += part_gradients[part](k);
+		*trainable_vars[k] += vars_change;
+	});
+	model_local.trainable_vars_updated();
+	publish_acting_model();
+	refresh_target_values();
+	const auto end = std::chrono::steady_clock::now();
+	training_nanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+		std::memory_order_relaxed);
+	last_training_nanoseconds.store(std::chrono::duration_cast<std::chrono::nanoseconds>(end - creation_time).count(),
+		std::memory_order_relaxed);
+	training_steps_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+//values that are no longer valid are found in advance, a few after every training step, going round the memory
+void dqn::Q::QPrivate::refresh_target_values()
+{
+	if (parameters.targets_refresh_number == 0)
+		return;
+	std::unique_lock lock(replay_mutex);
+	std::vector<std::size_t> stale;
+	for (std::size_t checked = 0; checked < trace.size() && stale.size() < parameters.targets_refresh_number; ++checked)
+	{
+		const std::size_t index = refresh_cursor++ % trace.size();
+		if (!trace.done(index) && target_versions[index] != target_version)
+			stale.push_back(index);
+	}
+	TargetEvaluation evaluation = prepare_targets(std::move(stale));
+	lock.unlock();
+	evaluate_targets(evaluation);
+	lock.lock();
+	store_target_values(evaluation);
+}
+
+void dqn::Q::QPrivate::train_part(const Batch& batch, const std::vector<float>& targets, const xt::xarray<float>& states,
+	const xt::xarray<float>& actions, std::size_t part_begin, std::size_t part_end, std::vector<float>& new_priorities,
+	xt::xarray<xt::xarray<float>>& gradient)
+{
 	nn::Tape tape;
-	const auto l_value = model_local.call({ transition.state, transition.action }, &tape);
-	const auto grads = model_local.get_gradient(l_value, tape);
-	float target = transition.reward;
-	if (!transition.done)
-		target += parameters.gamma * find_best(transition.afterstate, transition.possible_actions, model_target).value;
-	const float td_error = target - l_value.TO_SCALAR;
+	const auto l_values = model_local.call({ xt::view(states, xt::range(part_begin, part_end)),
+		xt::view(actions, xt::range(part_begin, part_end)) }, &tape);
+	//backward sums derivatives over the batch, so the change for every transition is set through its deltas
+	auto deltas = xt::xarray<float>::from_shape(l_values.shape());
+	for (std::size_t i = part_begin; i < part_end; ++i)
 	{
-#if USE_MULTITHREADING_IN_Q
-		std::lock_guard<std::mutex> lg(vars_change_mutex);
-#endif
-		vars_change += parameters.alpha * importance_weight * td_error * grads;
+		const float td_error = targets[i] - l_values(i - part_begin, 0);
+		deltas(i - part_begin, 0) = parameters.alpha * batch.importance_weights(i) * td_error;
+		new_priorities[i] = std::pow(std::abs(td_error) + parameters.min_priority, parameters.priority_scale);
 	}
-	//different threads access completely different indices & no change in the vector's size -> no need to lock
-	priorities[trace_index] = std::pow(std::abs(td_error) + parameters.min_priority, parameters.priority_scale);
+	gradient = model_local.get_gradient(l_values, deltas, tape);
 }
 
-void dqn::Q::QPrivate::update(float reward, const xt::xarray<float>& afterstate, const xt::xarray<float>& possible_actions, bool done)
+void dqn::Q::QPrivate::update(float reward, bool done)
 {
-	if (trace.size() >= parameters.max_trace)
 	{
-		trace.erase(trace.begin());
-		priorities.erase(priorities.begin());
+		const std::lock_guard lock(replay_mutex);
+		const std::size_t index = trace.push(prev_record.step, prev_record.action_index, reward, done);
+		add_new_priority(index);
+		target_versions[index] = 0;
+		slot_generations[index]++;
+		transitions_count.fetch_add(1, std::memory_order_relaxed);
+		replay_size.store(trace.size(), std::memory_order_relaxed);
+		store_priority_stats();
+		if (trace.size() < parameters.min_trace)
+			return;
+		if (parameters.background_training)
+		{
+			new_transitions++;
+			transitions_added.notify_one();
+			return;
+		}
 	}
-	trace.emplace_back( 
-		prev_record.state, 
-		prev_record.action, 
-		reward, 
-		afterstate, 
-		possible_actions, 
-		done );
-	add_new_priority();
-	if (trace.size() < parameters.min_trace)
-		return;
 	if (train_count < parameters.train_local)
 	{
 		train_count++;
 		return;
 	}
-	train_model();
 	train_count = 0;
+	train_step();
+}
+
+void dqn::Q::QPrivate::train_step()
+{
+	train_model();
 	if (eps > parameters.min_eps)
 		eps -= parameters.eps_decr;
 	if (beta < 1)
 		beta += parameters.beta_incr;
+	save_if_due();
 	if (update_count < parameters.update_target)
 	{
 		update_count++;
@@ -333,16 +743,67 @@ void dqn::Q::QPrivate::global_update()
 	const nn::TrainableVars target_trainable_vars = model_target.get_trainable_vars_fixed();
 	for (std::size_t i = 0; i < target_trainable_vars.size(); ++i)
 		*target_trainable_vars[i] = *local_trainable_vars[i];
+	model_target.trainable_vars_updated();
+	target_version++;
 	update_count = 0;
+	target_updates_count.fetch_add(1, std::memory_order_relaxed);
 }
 
-void dqn::Q::QPrivate::add_new_priority()
+//the local model is copied into the spare model, which then replaces the published one,
+//if the acting thread still holds the spare model, the local model is published after the next training step
+void dqn::Q::QPrivate::publish_acting_model()
 {
-	if (priorities.empty())
-		priorities.push_back(max_priority);
-	else
-		priorities.push_back(*std::max_element(priorities.begin(), priorities.end()));
+	if (!parameters.background_training)
+		return;
+	if (spare_model.use_count() > 1)
+		return;
+	//the acting thread released the model, its reads happen before the model is overwritten
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const nn::TrainableVars local_trainable_vars = model_local.get_trainable_vars_fixed();
+	const nn::TrainableVars spare_trainable_vars = spare_model->get_trainable_vars_fixed();
+	for (std::size_t i = 0; i < spare_trainable_vars.size(); ++i)
+		*spare_trainable_vars[i] = *local_trainable_vars[i];
+	spare_model->trainable_vars_updated();
+	const std::lock_guard lock(acting_model_mutex);
+	acting_model.swap(spare_model);
+}
+
+//the learner trains once per train_local + 1 new transitions, as update does, but transitions that arrive
+//while it trains are not made up for later, so that it never falls behind the acting thread
+void dqn::Q::QPrivate::learn()
+{
+	const std::size_t transitions_per_training = static_cast<std::size_t>(std::max(parameters.train_local, 0)) + 1;
+	std::unique_lock lock(replay_mutex);
+	while (true)
+	{
+		transitions_added.wait(lock, [&] { return stop_learner || new_transitions >= transitions_per_training; });
+		if (stop_learner)
+			return;
+		new_transitions = 0;
+		lock.unlock();
+		train_step();
+		lock.lock();
+	}
+}
+
+//new transitions get the highest priority so far
+void dqn::Q::QPrivate::add_new_priority(std::size_t index)
+{
+	set_priority(index, priorities.total() == 0.0f ? max_priority : priorities.max());
+}
+
+//the replay memory must be locked
+void dqn::Q::QPrivate::store_priority_stats()
+{
+	mean_priority.store(trace.size() > 0 ? priorities.total() / trace.size() : 0.0f, std::memory_order_relaxed);
+	highest_priority.store(trace.size() > 0 ? priorities.max() : 0.0f, std::memory_order_relaxed);
+}
+
+//the replay memory keeps a copy of every priority, so that the tree can be rebuilt when it is reopened
+void dqn::Q::QPrivate::set_priority(std::size_t index, float priority)
+{
+	priorities.set(index, priority);
+	trace.set_priority(index, priority);
 }
 
-#undef TO_SCALAR
-#undef USE_MULTITHREADING_IN_Q
\ No newline at end of file
+#undef TO_SCALAR
\ No newline at end of file
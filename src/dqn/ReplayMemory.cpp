@@ -0,0 +1,360 @@
+#include "dqn/ReplayMemory.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <cstring>
+
+//the region starts with the header, which is followed by binary flags of the codec, slabs of transitions,
+//the steps table and the slab of boards, every part starts at a multiple of region_alignment bytes
+namespace
+{
+	constexpr char replay_magic[8] = { 'D', 'Q', 'N', 'R', 'E', 'P', 'L', 'Y' };
+	constexpr std::uint32_t replay_version = 1;
+	constexpr std::size_t region_alignment = 64;
+	const std::string temporary_suffix = ".tmp";
+
+	struct ReplayHeader
+	{
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t precision;
+		std::uint64_t capacity;
+		std::uint64_t cells_number;
+		std::uint64_t channels_number;
+		std::uint64_t steps_table_size;
+		std::uint64_t boards_slab_size;
+		std::uint64_t board_size;
+		std::uint64_t transitions_number;
+		std::uint64_t next_slot;
+		std::uint64_t next_step;
+		std::uint64_t boards_head;
+	};
+
+	std::size_t aligned(std::size_t offset)
+	{
+		return (offset + region_alignment - 1) / region_alignment * region_alignment;
+	}
+}
+
+//a transition refers to at most two steps and only the last step may have no transitions referring to it,
+//so the steps table never has to grow in normal use
+dqn::ReplayMemory::ReplayMemory(std::size_t capacity, std::size_t cells_number, std::size_t channels_number,
+	ReplayPrecision precision, std::string filename) :
+	capacity(capacity), cells_number(cells_number), channels_number(channels_number),
+	sample_size(cells_number * channels_number), precision(precision), codec(precision, cells_number, channels_number),
+	board_size(codec.encoded_size()), steps_table_size(2 * capacity + 2), boards_slab_size(capacity),
+	filename(std::move(filename))
+{
+	if (!this->filename.empty() && open_file())
+		return;
+	const Layout new_layout = make_layout(steps_table_size, boards_slab_size * board_size);
+	replace_region(create_region(new_layout.size), new_layout);
+	store_header();
+}
+
+dqn::ReplayMemory::Layout dqn::ReplayMemory::make_layout(std::size_t steps_table_size, std::size_t boards_slab_bytes) const
+{
+	Layout new_layout;
+	std::size_t offset = sizeof(ReplayHeader);
+	const auto place = [&](std::size_t size) {
+		const std::size_t part = aligned(offset);
+		offset = part + size;
+		return part;
+	};
+	new_layout.binary_flags = place(channels_number);
+	new_layout.state_steps = place(capacity * sizeof(std::uint64_t));
+	new_layout.action_indices = place(capacity * sizeof(std::uint64_t));
+	new_layout.rewards = place(capacity * sizeof(float));
+	new_layout.priorities = place(capacity * sizeof(float));
+	new_layout.dones = place(capacity);
+	new_layout.steps_positions = place(steps_table_size * sizeof(std::uint64_t));
+	new_layout.steps_actions_numbers = place(steps_table_size * sizeof(std::uint64_t));
+	new_layout.boards = place(boards_slab_bytes);
+	new_layout.size = aligned(offset);
+	return new_layout;
+}
+
+//a file region is created next to the file and takes its name in replace_region,
+//if the file cannot be created the memory stays on the heap
+dqn::ReplayMemory::Region dqn::ReplayMemory::create_region(std::size_t size)
+{
+	Region new_region;
+	if (!filename.empty())
+	{
+		std::error_code error;
+		std::filesystem::remove(filename + temporary_suffix, error);
+		new_region.file = std::make_unique<nn::MappedFile>(filename + temporary_suffix, size);
+		if (new_region.file->is_open())
+		{
+			new_region.data = new_region.file->data();
+			return new_region;
+		}
+		new_region.file.reset();
+		filename.clear();
+	}
+	new_region.heap.resize(size);
+	new_region.data = new_region.heap.data();
+	return new_region;
+}
+
+void dqn::ReplayMemory::replace_region(Region new_region, const Layout& new_layout)
+{
+	//the old file is unmapped before the new one is renamed over it
+	region = Region();
+	if (new_region.file)
+	{
+		new_region.file.reset();
+		std::error_code error;
+		std::filesystem::rename(filename + temporary_suffix, filename, error);
+		new_region.file = std::make_unique<nn::MappedFile>(error ? filename + temporary_suffix : filename, new_layout.size);
+		new_region.data = new_region.file->data();
+	}
+	take_region(std::move(new_region), new_layout);
+}
+
+void dqn::ReplayMemory::take_region(Region new_region, const Layout& new_layout)
+{
+	region = std::move(new_region);
+	layout = new_layout;
+	state_steps = reinterpret_cast<std::uint64_t*>(region.data + layout.state_steps);
+	action_indices = reinterpret_cast<std::uint64_t*>(region.data + layout.action_indices);
+	rewards = reinterpret_cast<float*>(region.data + layout.rewards);
+	priorities = reinterpret_cast<float*>(region.data + layout.priorities);
+	dones = region.data + layout.dones;
+	steps_positions = reinterpret_cast<std::uint64_t*>(region.data + layout.steps_positions);
+	steps_actions_numbers = reinterpret_cast<std::uint64_t*>(region.data + layout.steps_actions_numbers);
+	boards = region.data + layout.boards;
+}
+
+//the file is only reopened if it was written for the same capacity, board and precision,
+//otherwise it is replaced by an empty memory
+bool dqn::ReplayMemory::open_file()
+{
+	ReplayHeader header;
+	Layout file_layout;
+	{
+		const nn::MappedFile file(filename);
+		if (!file.is_open() || file.size() < sizeof(ReplayHeader))
+			return false;
+		std::memcpy(&header, file.data(), sizeof(ReplayHeader));
+		if (!std::equal(std::begin(replay_magic), std::end(replay_magic), header.magic) || header.version != replay_version ||
+			header.precision != static_cast<std::uint32_t>(precision) || header.capacity != capacity ||
+			header.cells_number != cells_number || header.channels_number != channels_number)
+			return false;
+		file_layout = make_layout(header.steps_table_size, header.boards_slab_size * header.board_size);
+		if (file.size() < file_layout.size || header.steps_table_size == 0 || header.boards_slab_size == 0)
+			return false;
+		const BoardCodec file_codec(precision, cells_number, channels_number, file.data() + file_layout.binary_flags);
+		if (file_codec.encoded_size() != header.board_size)
+			return false;
+	}
+	Region file_region;
+	file_region.file = std::make_unique<nn::MappedFile>(filename, file_layout.size);
+	if (!file_region.file->is_open())
+		return false;
+	file_region.data = file_region.file->data();
+	steps_table_size = header.steps_table_size;
+	boards_slab_size = header.boards_slab_size;
+	board_size = header.board_size;
+	transitions_number = header.transitions_number;
+	next_slot = header.next_slot;
+	next_step = header.next_step;
+	boards_head = header.boards_head;
+	codec = BoardCodec(precision, cells_number, channels_number, file_region.data + file_layout.binary_flags);
+	take_region(std::move(file_region), file_layout);
+	return true;
+}
+
+void dqn::ReplayMemory::store_header()
+{
+	ReplayHeader header{};
+	std::copy(std::begin(replay_magic), std::end(replay_magic), header.magic);
+	header.version = replay_version;
+	header.precision = static_cast<std::uint32_t>(precision);
+	header.capacity = capacity;
+	header.cells_number = cells_number;
+	header.channels_number = channels_number;
+	header.steps_table_size = steps_table_size;
+	header.boards_slab_size = boards_slab_size;
+	header.board_size = board_size;
+	std::memcpy(region.data, &header, sizeof(ReplayHeader));
+	codec.store_binary_flags(region.data + layout.binary_flags);
+	store_counters();
+}
+
+void dqn::ReplayMemory::store_counters()
+{
+	ReplayHeader header;
+	std::memcpy(&header, region.data, sizeof(ReplayHeader));
+	header.transitions_number = transitions_number;
+	header.next_slot = next_slot;
+	header.next_step = next_step;
+	header.boards_head = boards_head;
+	std::memcpy(region.data, &header, sizeof(ReplayHeader));
+}
+
+//steps before the state of the oldest transition are not referred to anymore
+std::size_t dqn::ReplayMemory::first_live_step() const
+{
+	if (transitions_number > 0)
+		return state_steps[oldest_slot()];
+	return next_step > 0 ? next_step - 1 : 0;
+}
+
+std::size_t dqn::ReplayMemory::add_step(const float* state, const float* actions, std::size_t actions_number)
+{
+	if (next_step - first_live_step() == steps_table_size)
+		grow_steps_table();
+	if (!codec.accepts(state, 1) || !codec.accepts(actions, actions_number))
+	{
+		BoardCodec widened_codec = codec;
+		widened_codec.widen(state, 1);
+		widened_codec.widen(actions, actions_number);
+		recode(widened_codec);
+	}
+	const std::size_t position = allocate_boards(1 + actions_number);
+	codec.encode(state, 1, board_at(position));
+	codec.encode(actions, actions_number, board_at(position + 1));
+	steps_positions[next_step % steps_table_size] = position;
+	steps_actions_numbers[next_step % steps_table_size] = actions_number;
+	const std::size_t step = next_step++;
+	store_counters();
+	return step;
+}
+
+void dqn::ReplayMemory::discard_step(std::size_t step)
+{
+	if (step + 1 != next_step)
+		return;
+	//transitions are added in the order of their steps, so only the newest one may refer to the last step
+	if (transitions_number > 0)
+	{
+		const std::size_t newest_slot = (next_slot + capacity - 1) % capacity;
+		if (state_steps[newest_slot] == step || (!dones[newest_slot] && state_steps[newest_slot] + 1 == step))
+			return;
+	}
+	boards_head = step_position(step);
+	next_step = step;
+	store_counters();
+}
+
+std::size_t dqn::ReplayMemory::push(std::size_t step, std::size_t action_index, float reward, bool done)
+{
+	const std::size_t slot = next_slot;
+	state_steps[slot] = step;
+	action_indices[slot] = action_index;
+	rewards[slot] = reward;
+	dones[slot] = done;
+	next_slot = (next_slot + 1) % capacity;
+	if (transitions_number < capacity)
+		transitions_number++;
+	store_counters();
+	return slot;
+}
+
+//boards of a step are never split, if they do not fit before the end of the slab they start from its beginning
+std::size_t dqn::ReplayMemory::allocate_boards(std::size_t boards_number)
+{
+	std::size_t position = boards_head;
+	if (position % boards_slab_size + boards_number > boards_slab_size)
+		position += boards_slab_size - position % boards_slab_size;
+	const std::size_t first_step = first_live_step();
+	const std::size_t tail = next_step > first_step ? step_position(first_step) : position;
+	if (position + boards_number - tail > boards_slab_size)
+	{
+		grow_boards(boards_number);
+		position = boards_head;
+	}
+	boards_head = position + boards_number;
+	return position;
+}
+
+//the slab is only reallocated while the memory is filling up or when more actions than ever before arrive,
+//boards of live steps are moved to its beginning, parts before the steps table are laid out the same way
+void dqn::ReplayMemory::grow_boards(std::size_t boards_number)
+{
+	const std::size_t first_step = first_live_step();
+	std::size_t used = 0;
+	for (std::size_t step = first_step; step < next_step; ++step)
+		used += 1 + step_actions_number(step);
+	const std::size_t grown_slab_size = std::max(2 * boards_slab_size, used + boards_number);
+	const Layout grown_layout = make_layout(steps_table_size, grown_slab_size * board_size);
+	Region grown = create_region(grown_layout.size);
+	std::copy_n(region.data, layout.steps_positions, grown.data);
+	std::copy_n(region.data + layout.steps_actions_numbers, steps_table_size * sizeof(std::uint64_t),
+		grown.data + grown_layout.steps_actions_numbers);
+	std::uint64_t* grown_positions = reinterpret_cast<std::uint64_t*>(grown.data + grown_layout.steps_positions);
+	std::size_t position = 0;
+	for (std::size_t step = first_step; step < next_step; ++step)
+	{
+		const std::size_t step_boards = 1 + step_actions_number(step);
+		std::copy_n(board_at(step_position(step)), step_boards * board_size, grown.data + grown_layout.boards + position * board_size);
+		grown_positions[step % steps_table_size] = position;
+		position += step_boards;
+	}
+	boards_slab_size = grown_slab_size;
+	boards_head = position;
+	replace_region(std::move(grown), grown_layout);
+	store_header();
+}
+
+//boards keep their positions, only their size changes
+void dqn::ReplayMemory::recode(const BoardCodec& widened_codec)
+{
+	const std::size_t widened_board_size = widened_codec.encoded_size();
+	const Layout recoded_layout = make_layout(steps_table_size, boards_slab_size * widened_board_size);
+	Region recoded = create_region(recoded_layout.size);
+	std::copy_n(region.data, layout.boards, recoded.data);
+	std::vector<float> board(sample_size);
+	for (std::size_t step = first_live_step(); step < next_step; ++step)
+		for (std::size_t i = 0; i <= step_actions_number(step); ++i)
+		{
+			const std::size_t position = (step_position(step) + i) % boards_slab_size;
+			codec.decode(boards + position * board_size, 1, board.data());
+			widened_codec.encode(board.data(), 1, recoded.data + recoded_layout.boards + position * widened_board_size);
+		}
+	codec = widened_codec;
+	board_size = widened_board_size;
+	replace_region(std::move(recoded), recoded_layout);
+	store_header();
+}
+
+void dqn::ReplayMemory::grow_steps_table()
+{
+	const std::size_t size = 2 * steps_table_size;
+	const Layout grown_layout = make_layout(size, boards_slab_size * board_size);
+	Region grown = create_region(grown_layout.size);
+	std::copy_n(region.data, layout.steps_positions, grown.data);
+	std::uint64_t* positions = reinterpret_cast<std::uint64_t*>(grown.data + grown_layout.steps_positions);
+	std::uint64_t* actions_numbers = reinterpret_cast<std::uint64_t*>(grown.data + grown_layout.steps_actions_numbers);
+	for (std::size_t step = first_live_step(); step < next_step; ++step)
+	{
+		positions[step % size] = step_position(step);
+		actions_numbers[step % size] = step_actions_number(step);
+	}
+	std::copy_n(boards, boards_slab_size * board_size, grown.data + grown_layout.boards);
+	steps_table_size = size;
+	replace_region(std::move(grown), grown_layout);
+	store_header();
+}
+
+void dqn::ReplayMemory::gather(const std::size_t* slots, std::size_t slots_number, float* states_batch,
+	float* actions_batch) const
+{
+	for (std::size_t i = 0; i < slots_number; ++i)
+	{
+		const std::size_t position = step_position(state_steps[slots[i]]);
+		codec.decode(board_at(position), 1, states_batch + i * sample_size);
+		codec.decode(board_at(position + 1 + action_indices[slots[i]]), 1, actions_batch + i * sample_size);
+	}
+}
+
+void dqn::ReplayMemory::copy_afterstate(std::size_t slot, float* destination) const
+{
+	codec.decode(board_at(step_position(state_steps[slot] + 1)), 1, destination);
+}
+
+void dqn::ReplayMemory::copy_possible_actions(std::size_t slot, float* destination) const
+{
+	codec.decode(board_at(step_position(state_steps[slot] + 1) + 1), actions_number(slot), destination);
+}
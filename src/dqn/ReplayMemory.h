@@ -0,0 +1,131 @@
+#ifndef DQN_REPLAYMEMORY_H
+#define DQN_REPLAYMEMORY_H
+
+#include "dqn/BoardCodec.h"
+#include "neural_network/utils/MappedFile.h"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace dqn
+{
+	//history of transitions with a fixed capacity, once it is full every new transition overwrites the oldest one
+	//a transition is identified by its slot, slots stay the same until the transition is overwritten
+	//
+	//boards are not copied into transitions: every call with possible actions adds a step, which is the state
+	//together with the actions it allows, and a transition refers to the step it was made from, the index of the chosen
+	//action and, unless it is the last one of an episode, the next step as its afterstate and possible actions
+	//
+	//everything, including priorities of transitions, is kept in a single region of memory, which is either allocated
+	//on the heap or is a mapped file, in the latter case the memory is reopened from the file by the next run
+	class ReplayMemory
+	{
+	private:
+		//offsets of the parts of the region, see ReplayMemory.cpp
+		struct Layout
+		{
+			std::size_t binary_flags;
+			std::size_t state_steps;
+			std::size_t action_indices;
+			std::size_t rewards;
+			std::size_t priorities;
+			std::size_t dones;
+			std::size_t steps_positions;
+			std::size_t steps_actions_numbers;
+			std::size_t boards;
+			std::size_t size;
+		};
+
+		//while a new region is filled, the current one stays readable
+		struct Region
+		{
+			std::vector<unsigned char> heap;
+			std::unique_ptr<nn::MappedFile> file;
+			unsigned char* data = nullptr;
+		};
+
+		std::size_t capacity;
+		std::size_t cells_number;
+		std::size_t channels_number;
+		//number of floats in a single board
+		std::size_t sample_size;
+		ReplayPrecision precision;
+		BoardCodec codec;
+		//number of bytes in a single encoded board
+		std::size_t board_size;
+		std::size_t transitions_number = 0;
+		std::size_t next_slot = 0;
+
+		//steps are numbered in the order they are added, a step is kept while a transition refers to it
+		//or while it is the last one, information about step n is kept at n modulo the size of the steps table
+		std::size_t next_step = 0;
+		std::size_t steps_table_size;
+
+		//boards of a step (the state followed by the actions) are kept together in a circular slab
+		//in the order steps are added, positions only grow and are taken modulo the slab size
+		std::size_t boards_slab_size;
+		std::size_t boards_head = 0;
+
+		std::string filename;
+		Region region;
+		Layout layout;
+		std::uint64_t* state_steps = nullptr;
+		std::uint64_t* action_indices = nullptr;
+		float* rewards = nullptr;
+		float* priorities = nullptr;
+		unsigned char* dones = nullptr;
+		std::uint64_t* steps_positions = nullptr;
+		std::uint64_t* steps_actions_numbers = nullptr;
+		unsigned char* boards = nullptr;
+
+		Layout make_layout(std::size_t steps_table_size, std::size_t boards_slab_bytes) const;
+		Region create_region(std::size_t size);
+		//a new file region takes the name of the file, the old region is released
+		void replace_region(Region new_region, const Layout& new_layout);
+		void take_region(Region new_region, const Layout& new_layout);
+		bool open_file();
+		void store_header();
+		void store_counters();
+
+		std::size_t oldest_slot() const { return (next_slot + capacity - transitions_number) % capacity; }
+		std::size_t first_live_step() const;
+		std::size_t step_position(std::size_t step) const { return steps_positions[step % steps_table_size]; }
+		std::size_t step_actions_number(std::size_t step) const { return steps_actions_numbers[step % steps_table_size]; }
+		unsigned char* board_at(std::size_t position) { return boards + position % boards_slab_size * board_size; }
+		const unsigned char* board_at(std::size_t position) const { return boards + position % boards_slab_size * board_size; }
+		std::size_t allocate_boards(std::size_t boards_number);
+		void grow_boards(std::size_t boards_number);
+		void recode(const BoardCodec& widened_codec);
+		void grow_steps_table();
+
+	public:
+		//if filename is not empty, the memory is kept in that file and is reopened from it if the file matches
+		ReplayMemory(std::size_t capacity, std::size_t cells_number, std::size_t channels_number, ReplayPrecision precision,
+			std::string filename = "");
+
+		std::size_t size() const { return transitions_number; }
+		//adds a state together with the actions allowed in it, returns the number of the new step
+		std::size_t add_step(const float* state, const float* actions, std::size_t actions_number);
+		//forgets the last step if no transition refers to it, is used when an episode is abandoned
+		void discard_step(std::size_t step);
+		//adds a transition from the given step, the oldest one is overwritten if the memory is full,
+		//returns the slot of the new transition, unless done the next step must already be added
+		std::size_t push(std::size_t step, std::size_t action_index, float reward, bool done);
+
+		float reward(std::size_t slot) const { return rewards[slot]; }
+		bool done(std::size_t slot) const { return dones[slot]; }
+		std::size_t actions_number(std::size_t slot) const { return dones[slot] ? 0 : step_actions_number(state_steps[slot] + 1); }
+		//priorities are kept here only so that they survive reopening, transitions are drawn with SumTree
+		float priority(std::size_t slot) const { return priorities[slot]; }
+		void set_priority(std::size_t slot, float priority) { priorities[slot] = priority; }
+		//copies states and chosen actions of the given slots one after another, so that they form a batch
+		void gather(const std::size_t* slots, std::size_t slots_number, float* states_batch, float* actions_batch) const;
+		void copy_afterstate(std::size_t slot, float* destination) const;
+		void copy_possible_actions(std::size_t slot, float* destination) const;
+	};
+}
+
+#endif
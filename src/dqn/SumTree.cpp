@@ -0,0 +1,50 @@
+#include "dqn/SumTree.h"
+
+#include <algorithm>
+#include <limits>
+
+dqn::SumTree::SumTree(std::size_t capacity)
+{
+	while (leaves_number < capacity)
+		leaves_number *= 2;
+	sums.assign(2 * leaves_number, 0.0f);
+	mins.assign(2 * leaves_number, std::numeric_limits<float>::infinity());
+	maxs.assign(2 * leaves_number, 0.0f);
+}
+
+void dqn::SumTree::set_leaf(std::size_t index, float sum, float min, float max)
+{
+	std::size_t node = leaves_number + index;
+	sums[node] = sum;
+	mins[node] = min;
+	maxs[node] = max;
+	for (node /= 2; node > 0; node /= 2)
+	{
+		sums[node] = sums[2 * node] + sums[2 * node + 1];
+		mins[node] = std::min(mins[2 * node], mins[2 * node + 1]);
+		maxs[node] = std::max(maxs[2 * node], maxs[2 * node + 1]);
+	}
+}
+
+void dqn::SumTree::remove(std::size_t index)
+{
+	set_leaf(index, 0.0f, std::numeric_limits<float>::infinity(), 0.0f);
+}
+
+std::size_t dqn::SumTree::find(float prefix) const
+{
+	std::size_t node = 1;
+	while (node < leaves_number)
+	{
+		const std::size_t left = 2 * node;
+		//because of rounding prefix may reach the sum of the right subtree, empty subtrees are never entered
+		if (prefix < sums[left] || sums[left + 1] == 0.0f)
+			node = left;
+		else
+		{
+			prefix -= sums[left];
+			node = left + 1;
+		}
+	}
+	return node - leaves_number;
+}
@@ -0,0 +1,42 @@
+#ifndef DQN_SUMTREE_H
+#define DQN_SUMTREE_H
+
+#include <vector>
+#include <cstddef>
+
+namespace dqn
+{
+	//segment tree over priorities of a fixed number of slots
+	//every inner node keeps the sum, the minimum and the maximum of its subtree, so all of them are found at the root
+	//and changing a priority or finding a slot by a prefix sum only walks from a leaf to the root or back
+	class SumTree
+	{
+	private:
+		//leaves start at leaves_number, the root is at 1
+		std::size_t leaves_number = 1;
+		std::vector<float> sums;
+		std::vector<float> mins;
+		std::vector<float> maxs;
+
+		void set_leaf(std::size_t index, float sum, float min, float max);
+
+	public:
+		explicit SumTree(std::size_t capacity);
+
+		//sets priority of a slot, priorities must not be negative
+		void set(std::size_t index, float priority) { set_leaf(index, priority, priority, priority); }
+		//removes a slot from the tree, it is not counted in the sum, the minimum or the maximum until it is set again
+		void remove(std::size_t index);
+		float get(std::size_t index) const { return sums[leaves_number + index]; }
+
+		float total() const { return sums[1]; }
+		//minimum and maximum are only meaningful if there is at least one slot with priority set
+		float min() const { return mins[1]; }
+		float max() const { return maxs[1]; }
+
+		//returns the slot at which the running sum of priorities first exceeds prefix, prefix must be below total
+		std::size_t find(float prefix) const;
+	};
+}
+
+#endif
@@ -0,0 +1,75 @@
+#include "dqn/ThreadPool.h"
+
+#include <algorithm>
+
+dqn::ThreadPool::ThreadPool(std::size_t workers_number)
+{
+	if (workers_number == 0)
+		workers_number = std::max(1u, std::thread::hardware_concurrency());
+	threads.reserve(workers_number - 1);
+	for (std::size_t worker_index = 1; worker_index < workers_number; ++worker_index)
+		threads.emplace_back(&ThreadPool::work, this, worker_index);
+}
+
+dqn::ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lg(mutex);
+		stopping = true;
+	}
+	job_started.notify_all();
+	for (auto& thread : threads)
+		thread.join();
+}
+
+void dqn::ThreadPool::run_tasks(std::size_t worker_index)
+{
+	for (std::size_t task_index = next_task++; task_index < tasks_number; task_index = next_task++)
+		(*task)(task_index, worker_index);
+}
+
+void dqn::ThreadPool::work(std::size_t worker_index)
+{
+	std::size_t seen_generation = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			job_started.wait(lock, [&] { return stopping || generation != seen_generation; });
+			if (stopping)
+				return;
+			seen_generation = generation;
+		}
+		run_tasks(worker_index);
+		{
+			std::lock_guard<std::mutex> lg(mutex);
+			if (--busy_threads == 0)
+				job_finished.notify_one();
+		}
+	}
+}
+
+void dqn::ThreadPool::parallel_for(std::size_t tasks_number, const Task& task)
+{
+	//waking the workers is not worth it if there is nothing to share
+	if (threads.empty() || tasks_number <= 1)
+	{
+		for (std::size_t task_index = 0; task_index < tasks_number; ++task_index)
+			task(task_index, 0);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lg(mutex);
+		this->task = &task;
+		this->tasks_number = tasks_number;
+		next_task = 0;
+		busy_threads = threads.size();
+		++generation;
+	}
+	job_started.notify_all();
+	run_tasks(0);
+	std::unique_lock<std::mutex> lock(mutex);
+	job_finished.wait(lock, [&] { return busy_threads == 0; });
+	this->task = nullptr;
+	this->tasks_number = 0;
+}
@@ -0,0 +1,53 @@
+#ifndef DQN_THREADPOOL_H
+#define DQN_THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+namespace dqn
+{
+	//persistent workers for fork-join parallel loops
+	//the thread calling parallel_for works as well, so the pool starts one thread less than the number of workers
+	class ThreadPool
+	{
+	public:
+		//task is called with the task index and the index of the worker running it, worker indices are below workers_number
+		using Task = std::function<void(std::size_t task_index, std::size_t worker_index)>;
+
+	private:
+		std::vector<std::thread> threads;
+		std::mutex mutex;
+		std::condition_variable job_started;
+		std::condition_variable job_finished;
+
+		//current job, written under the mutex before the generation changes
+		const Task* task = nullptr;
+		std::size_t tasks_number = 0;
+		//tasks are handed out by incrementing the counter, so no lock is taken per task
+		std::atomic<std::size_t> next_task = 0;
+		std::size_t generation = 0;
+		std::size_t busy_threads = 0;
+		bool stopping = false;
+
+		void run_tasks(std::size_t worker_index);
+		void work(std::size_t worker_index);
+
+	public:
+		//0 workers means one worker per hardware thread
+		explicit ThreadPool(std::size_t workers_number);
+		~ThreadPool();
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		std::size_t workers_number() const { return threads.size() + 1; }
+		//runs task for every index in [0, tasks_number) and returns when all of them are done
+		//must not be called from inside of a task
+		void parallel_for(std::size_t tasks_number, const Task& task);
+	};
+}
+
+#endif
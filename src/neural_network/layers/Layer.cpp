@@ -1,8 +1,79 @@
 #include "neural_network/layers/Layer.h"
+#include "neural_network/utils/Profiler.h"
+
+#include <chrono>
+#include <cstdint>
+
+namespace
+{
+	std::uint64_t nanoseconds_since(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+}
 
 void nn::Layer::forward(xt::xarray<float>& inputs, Tape* tape) const
 {
-	if (tape)
-		tape->insert({ this, inputs });
+	if (profiler)
+		return forward_profiled(inputs, tape);
+	if (!tape)
+		return forward(inputs);
+	auto& record = (*tape)[this];
+	record.inputs = inputs;
+	forward(inputs, record);
+}
+
+void nn::Layer::forward(xt::xarray<float>& inputs, TapeRecord&) const
+{
 	forward(inputs);
-}
\ No newline at end of file
+}
+
+void nn::Layer::backward(xt::xarray<float>& outputs, xt::xarray<float>& deltas, Tape& tape, GradientMap& gradient_map) const
+{
+	auto& record = tape[this];
+	if (profiler)
+		return backward_profiled(outputs, deltas, record, gradient_map);
+	backward(outputs, deltas, record, gradient_map);
+}
+
+void nn::Layer::set_profiler(Profiler* profiler_to_set, std::size_t entry)
+{
+	profiler = profiler_to_set;
+	profiler_entry = entry;
+}
+
+//the same as forward without a profiler, timed, recorded inputs are counted among the produced tensors
+void nn::Layer::forward_profiled(xt::xarray<float>& inputs, Tape* tape) const
+{
+	const std::uint64_t flops = inputs.shape()[batch_size_axis] * forward_flops();
+	const auto start = std::chrono::steady_clock::now();
+	TapeRecord* record = nullptr;
+	if (tape)
+	{
+		record = &(*tape)[this];
+		record->inputs = inputs;
+		forward(inputs, *record);
+	}
+	else
+		forward(inputs);
+	const std::uint64_t nanoseconds = nanoseconds_since(start);
+	std::uint64_t bytes = inputs.size() * sizeof(float);
+	if (record)
+		bytes += record->inputs.size() * sizeof(float) + record->switches.size() * sizeof(std::size_t);
+	profiler->record(profiler_entry, Pass::Forward, nanoseconds, flops, bytes);
+}
+
+//backward is counted as twice the operations of forward: derivatives of inputs and of trainable vars
+void nn::Layer::backward_profiled(xt::xarray<float>& outputs, xt::xarray<float>& deltas, TapeRecord& record,
+	GradientMap& gradient_map) const
+{
+	const std::uint64_t flops = 2 * record.inputs.shape()[batch_size_axis] * forward_flops();
+	const auto start = std::chrono::steady_clock::now();
+	backward(outputs, deltas, record, gradient_map);
+	const std::uint64_t nanoseconds = nanoseconds_since(start);
+	std::uint64_t bytes = deltas.size() * sizeof(float);
+	for (const TrainableVarsType type : { TrainableVarsType::Weights, TrainableVarsType::Biases })
+		if (const auto derivative = gradient_map.find({ this, type }); derivative != gradient_map.end())
+			bytes += derivative->second.size() * sizeof(float);
+	profiler->record(profiler_entry, Pass::Backward, nanoseconds, flops, bytes);
+}
@@ -10,6 +10,8 @@
 
 namespace nn
 {
+	class Profiler;
+
 	using TrainableVars = std::vector<xt::xarray<float>*>;
 	using Axis = int;
 
@@ -28,17 +30,36 @@ namespace nn
 		static constexpr float lower_rand_bound = 0.0f;
 		static constexpr float upper_rand_bound = 0.1f;
 
+		//estimated number of floating point operations of forward for a single sample, known after build
+		virtual std::size_t forward_flops() const { return 0; }
+
 	public:
 		virtual void build(std::vector<std::size_t>& shape) = 0;
-		virtual void backward(xt::xarray<float>& outputs, xt::xarray<float>& deltas, Tape& tape, GradientMap& gradient_map) const = 0;
 		virtual void get_trainable_vars(TrainableVars& trainable_vars) = 0;
 		virtual void get_trainable_vars(TrainableVarsMap& trainable_vars_map) = 0;
 		virtual void print_trainable_vars() const = 0;
+		//must be called after trainable vars have been changed from outside of the layer
+		//so that the layer could rebuild everything it derives from them
+		virtual void trainable_vars_updated() {}
 
 		void forward(xt::xarray<float>& inputs, Tape* tape) const;
+		void backward(xt::xarray<float>& outputs, xt::xarray<float>& deltas, Tape& tape, GradientMap& gradient_map) const;
+		//forward and backward are reported to the profiler under the given entry, nullptr turns reporting off
+		void set_profiler(Profiler* profiler_to_set, std::size_t entry);
 
 	private:
+		Profiler* profiler = nullptr;
+		std::size_t profiler_entry = 0;
+
+		void forward_profiled(xt::xarray<float>& inputs, Tape* tape) const;
+		void backward_profiled(xt::xarray<float>& outputs, xt::xarray<float>& deltas, TapeRecord& record,
+			GradientMap& gradient_map) const;
 		virtual void forward(xt::xarray<float>& inputs) const = 0;
+		//called instead of the above when a tape is active, inputs are already recorded
+		//layers that need more than their inputs for backward override it
+		virtual void forward(xt::xarray<float>& inputs, TapeRecord& record) const;
+		virtual void backward(xt::xarray<float>& outputs, xt::xarray<float>& deltas, const TapeRecord& record,
+			GradientMap& gradient_map) const = 0;
 	};
 }
 
@@ -25,19 +25,32 @@ namespace nn
         std::size_t kernel_width;
         std::size_t filters_number;
         Padding padding;
-        std::vector<std::vector<std::size_t>> pads;
+        //rows and columns of zeros that implicitly surround inputs at the top and at the left
+        std::size_t pad_top = 0;
+        std::size_t pad_left = 0;
         Activation activation;
+        //filters transformed for Winograd convolution, empty if the layer uses the direct path
+        std::vector<float> winograd_filters;
+        bool use_winograd = false;
+
+        //derivatives of the convolution itself, deltas must already be multiplied by the derivative of the activation
+        //deltas are replaced with the deltas of inputs
+        void backward_linear(const xt::xarray<float>& inputs, xt::xarray<float>& deltas, GradientMap& gradient_map) const;
+        //counted as direct convolution, even if the layer uses Winograd convolution
+        virtual std::size_t forward_flops() const override;
 
     public:
         LayerConv2D(std::size_t filters_number, KernelSize kernel_size, Padding padding, Activation activation);
         virtual void build(std::vector<std::size_t>& shape) override;
-        virtual void backward(xt::xarray<float>& outputs, xt::xarray<float>& deltas, Tape& tape, GradientMap& gradient_map) const override;
         virtual void get_trainable_vars(TrainableVars& trainable_vars) override;
         virtual void get_trainable_vars(TrainableVarsMap& trainable_vars_map) override;
         virtual void print_trainable_vars() const override;
+        virtual void trainable_vars_updated() override;
 
     private:
         virtual void forward(xt::xarray<float>& inputs) const override;
+        virtual void backward(xt::xarray<float>& outputs, xt::xarray<float>& deltas, const TapeRecord& record,
+            GradientMap& gradient_map) const override;
     };
 }
 
@@ -0,0 +1,72 @@
+#include "neural_network/layers/LayerConv2DMaxPooling2D.h"
+#include "neural_network/utils/ActivationFunctions.h"
+#include "neural_network/utils/ConvolutePoolFunctions.h"
+
+nn::LayerConv2DMaxPooling2D::LayerConv2DMaxPooling2D(std::size_t filters_number, KernelSize kernel_size, Padding padding,
+	Activation activation, PoolSize pool_size) :
+	LayerConv2D(filters_number, kernel_size, padding, activation), pool_size(pool_size) {}
+
+void nn::LayerConv2DMaxPooling2D::build(std::vector<std::size_t>& shape)
+{
+	LayerConv2D::build(shape);
+	//Winograd tiles match pooling windows only for 2x2 pooling, other pool sizes use the direct path
+	if (pool_size != PoolSize{ 2,2 })
+	{
+		use_winograd = false;
+		winograd_filters.clear();
+	}
+	shape[height_axis] = (shape[height_axis] - 1) / pool_size.first + 1;
+	shape[width_axis] = (shape[width_axis] - 1) / pool_size.second + 1;
+	pooled_shape = shape;
+}
+
+//every convolution output is compared once while pooling
+std::size_t nn::LayerConv2DMaxPooling2D::forward_flops() const
+{
+	return LayerConv2D::forward_flops() + outputs_shape[height_axis] * outputs_shape[width_axis] * filters_number;
+}
+
+void nn::LayerConv2DMaxPooling2D::convolute_pool(xt::xarray<float>& inputs, std::vector<std::size_t>* switches) const
+{
+	std::vector<std::size_t> shape(pooled_shape);
+	shape[batch_size_axis] = inputs.shape()[batch_size_axis];
+	const std::size_t conv_height = outputs_shape[height_axis];
+	const std::size_t conv_width = outputs_shape[width_axis];
+	std::size_t* switches_data = nullptr;
+	if (switches)
+	{
+		switches->resize(shape[batch_size_axis] * pooled_shape[height_axis] * pooled_shape[width_axis] * filters_number);
+		switches_data = switches->data();
+	}
+	auto pooled = use_winograd ?
+		convolute2D_maxpool2D_winograd(inputs, winograd_filters, pad_top, pad_left, conv_height, conv_width, shape,
+			switches_data) :
+		convolute2D_maxpool2D_gemm(inputs, filters, pad_top, pad_left, conv_height, conv_width, pool_size, shape,
+			switches_data);
+	//biases are the same over a pooling window, so they can be added after pooling
+	bias_activate(pooled, biases, activation);
+	inputs = std::move(pooled);
+}
+
+void nn::LayerConv2DMaxPooling2D::forward(xt::xarray<float>& inputs) const
+{
+	convolute_pool(inputs, nullptr);
+}
+
+void nn::LayerConv2DMaxPooling2D::forward(xt::xarray<float>& inputs, TapeRecord& record) const
+{
+	convolute_pool(inputs, &record.switches);
+}
+
+void nn::LayerConv2DMaxPooling2D::backward(xt::xarray<float>& outputs, xt::xarray<float>& deltas, const TapeRecord& record,
+	GradientMap& gradient_map) const
+{
+	const auto& [inputs, switches] = record;
+	//the activation has been applied to the maximums, so its derivative is taken at pooled outputs
+	derive_multiply(deltas, outputs, activation);
+	std::vector<std::size_t> conv_shape(outputs_shape);
+	conv_shape[batch_size_axis] = inputs.shape()[batch_size_axis];
+	deltas = unmaxpool2D(switches, deltas, conv_shape);
+	backward_linear(inputs, deltas, gradient_map);
+	outputs = inputs;
+}
@@ -0,0 +1,36 @@
+#ifndef NEURALNETWORK_LAYERCONV2DMAXPOOLING2D_H
+#define NEURALNETWORK_LAYERCONV2DMAXPOOLING2D_H
+
+#include "neural_network/layers/LayerConv2D.h"
+
+namespace nn
+{
+    using PoolSize = std::pair<std::size_t, std::size_t>;
+
+    //LayerConv2D followed by LayerMaxPooling2D computed as one layer
+    //convolution outputs are pooled chunk by chunk and the activation is applied to the pooled values only,
+    //which gives the same result since all activations are non-decreasing
+    //during training only positions of maximums are recorded, not the convolution outputs
+    class LayerConv2DMaxPooling2D : public LayerConv2D
+    {
+    protected:
+        PoolSize pool_size;
+        std::vector<std::size_t> pooled_shape;
+
+        virtual std::size_t forward_flops() const override;
+
+    public:
+        LayerConv2DMaxPooling2D(std::size_t filters_number, KernelSize kernel_size, Padding padding, Activation activation,
+            PoolSize pool_size);
+        virtual void build(std::vector<std::size_t>& shape) override;
+
+    private:
+        void convolute_pool(xt::xarray<float>& inputs, std::vector<std::size_t>* switches) const;
+        virtual void forward(xt::xarray<float>& inputs) const override;
+        virtual void forward(xt::xarray<float>& inputs, TapeRecord& record) const override;
+        virtual void backward(xt::xarray<float>& outputs, xt::xarray<float>& deltas, const TapeRecord& record,
+            GradientMap& gradient_map) const override;
+    };
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include "neural_network/layers/LayerDense.h"
 #include "neural_network/utils/ActivationFunctions.h"
+#include "neural_network/utils/GemmFunctions.h"
 
 #include <xtensor/generators/xrandom.hpp>
 #include <xtensor/io/xio.hpp>
@@ -16,22 +17,46 @@ void nn::LayerDense::build(std::vector<std::size_t>& input_shape)
 	input_shape[input_axis] = outputs_number;
 }
 
+//a multiplication and an addition for every weight
+std::size_t nn::LayerDense::forward_flops() const
+{
+	return 2 * weights.size();
+}
+
 void nn::LayerDense::forward(xt::xarray<float>& inputs) const
 {
-	auto linear_res = xt::sum(weights * xt::view(inputs, xt::all(), xt::newaxis()), { input_axis + 1 }) + biases;
-	inputs = activate(linear_res, activation);
+	const std::size_t batch_size = inputs.shape()[batch_size_axis];
+	const std::size_t inputs_number = inputs.shape()[input_axis];
+	auto linear_res = xt::xarray<float>::from_shape({ batch_size, outputs_number });
+	//outputs = inputs * weights^T, weights are stored as outputs_number x inputs_number
+	gemm(batch_size, outputs_number, inputs_number, row_major(inputs.data(), inputs_number),
+		row_major(weights.data(), inputs_number).transposed(), linear_res.data(), outputs_number);
+	bias_activate(linear_res, biases, activation);
+	inputs = std::move(linear_res);
 }
 
-void nn::LayerDense::backward(xt::xarray<float>& outputs, xt::xarray<float>& deltas, Tape& tape, GradientMap& gradient_map) const
+void nn::LayerDense::backward(xt::xarray<float>& outputs, xt::xarray<float>& deltas, const TapeRecord& record,
+	GradientMap& gradient_map) const
 {
-	const auto& inputs = tape[this];
-	deltas *= derive(outputs, activation);
-	auto transposed_deltas = xt::view(xt::transpose(deltas), xt::all(), xt::newaxis());
-	auto weight_derivative = xt::sum(transposed_deltas * xt::transpose(inputs), { input_axis + 1 });
+	const auto& inputs = record.inputs;
+	derive_multiply(deltas, outputs, activation);
+	const std::size_t batch_size = deltas.shape()[batch_size_axis];
+	const std::size_t inputs_number = inputs.shape()[input_axis];
+	const MatrixView deltas_matrix = row_major(deltas.data(), outputs_number);
+	const MatrixView weights_matrix = row_major(weights.data(), inputs_number);
+
+	//weight derivative = deltas^T * inputs, summed over the batch by the matrix product
+	auto weight_derivative = xt::xarray<float>::from_shape(weights.shape());
+	gemm(outputs_number, inputs_number, batch_size, deltas_matrix.transposed(), row_major(inputs.data(), inputs_number),
+		weight_derivative.data(), inputs_number);
 	auto biases_derivative = xt::sum(deltas, { batch_size_axis });
 	gradient_map.insert({ {this, TrainableVarsType::Weights}, weight_derivative });
 	gradient_map.insert({ {this, TrainableVarsType::Biases}, biases_derivative });
-	deltas = xt::sum(xt::transpose(weights) * xt::view(deltas, xt::all(), xt::newaxis()), { input_axis + 1 });
+
+	//new deltas = deltas * weights
+	auto new_deltas = xt::xarray<float>::from_shape({ batch_size, inputs_number });
+	gemm(batch_size, inputs_number, outputs_number, deltas_matrix, weights_matrix, new_deltas.data(), inputs_number);
+	deltas = std::move(new_deltas);
 	outputs = inputs;
 }
 
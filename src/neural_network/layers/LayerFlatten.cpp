@@ -15,9 +15,10 @@ void nn::LayerFlatten::forward(xt::xarray<float>& inputs) const
 	inputs.reshape({ inputs.shape()[batch_size_axis], outputs_number });
 }
 
-void nn::LayerFlatten::backward(xt::xarray<float>& outputs, xt::xarray<float>& deltas, Tape& tape, GradientMap& gradient_map) const
+void nn::LayerFlatten::backward(xt::xarray<float>& outputs, xt::xarray<float>& deltas, const TapeRecord& record,
+	GradientMap& gradient_map) const
 {
-	const auto& inputs = tape[this];
+	const auto& inputs = record.inputs;
 	deltas.reshape(inputs.shape());
 	outputs = inputs;
 }
\ No newline at end of file
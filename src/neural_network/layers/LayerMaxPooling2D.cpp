@@ -10,6 +10,13 @@ void nn::LayerMaxPooling2D::build(std::vector<std::size_t>& input_shape)
 	outputs_shape = input_shape;
 }
 
+//every input in a pooling window is compared once
+std::size_t nn::LayerMaxPooling2D::forward_flops() const
+{
+	return outputs_shape[height_axis] * outputs_shape[width_axis] * outputs_shape[channels_axis] *
+		pool_size.first * pool_size.second;
+}
+
 void nn::LayerMaxPooling2D::forward(xt::xarray<float>& inputs) const
 {
 	std::vector<std::size_t> shape(outputs_shape);
@@ -17,9 +24,17 @@ void nn::LayerMaxPooling2D::forward(xt::xarray<float>& inputs) const
 	inputs = maxpool2D(inputs, shape, pool_size);
 }
 
-void nn::LayerMaxPooling2D::backward(xt::xarray<float>& outputs, xt::xarray<float>& deltas, Tape& tape, GradientMap& gradient_map) const
+void nn::LayerMaxPooling2D::forward(xt::xarray<float>& inputs, TapeRecord& record) const
+{
+	std::vector<std::size_t> shape(outputs_shape);
+	shape[batch_size_axis] = inputs.shape()[batch_size_axis];
+	inputs = maxpool2D(inputs, shape, pool_size, &record.switches);
+}
+
+void nn::LayerMaxPooling2D::backward(xt::xarray<float>& outputs, xt::xarray<float>& deltas, const TapeRecord& record,
+	GradientMap& gradient_map) const
 {
-	const auto& inputs = tape[this];
-	deltas = unmaxpool2D(inputs, outputs, deltas, pool_size);
+	const auto& [inputs, switches] = record;
+	deltas = unmaxpool2D(switches, deltas, inputs.shape());
 	outputs = inputs;
 }
\ No newline at end of file
@@ -13,16 +13,20 @@ namespace nn
 		std::vector<std::size_t> outputs_shape;
 		PoolSize pool_size;
 
+		virtual std::size_t forward_flops() const override;
+
 	public:
 		LayerMaxPooling2D(PoolSize pool_size);
 		virtual void build(std::vector<std::size_t>& input_shape) override;
-		virtual void backward(xt::xarray<float>& outputs, xt::xarray<float>& deltas, Tape& tape, GradientMap& gradient_map) const override;
 		virtual void get_trainable_vars(TrainableVars& trainable_vars) override {};
 		virtual void get_trainable_vars(TrainableVarsMap& trainable_vars_map) override {};
 		virtual void print_trainable_vars() const override {};
 
 	private:
 		virtual void forward(xt::xarray<float>& inputs) const override;
+		virtual void forward(xt::xarray<float>& inputs, TapeRecord& record) const override;
+		virtual void backward(xt::xarray<float>& outputs, xt::xarray<float>& deltas, const TapeRecord& record,
+			GradientMap& gradient_map) const override;
 	};
 }
 
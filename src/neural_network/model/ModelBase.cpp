@@ -1,5 +1,7 @@
 #include "neural_network/model/ModelBase.h"
 #include "neural_network/layers/Layer.h"
+#include "neural_network/model/WeightsFile.h"
+#include "neural_network/utils/Profiler.h"
 
 #include <xtensor/io/xjson.hpp>
 #include <xtensor/containers/xadapt.hpp>
@@ -15,9 +17,14 @@ void nn::ModelBase::build(std::vector<std::size_t> input_shape) const
 }
 
 xt::xarray<xt::xarray<float>> nn::ModelBase::get_gradient(xt::xarray<float> outputs, Tape& tape) const
+{
+	return get_gradient(std::move(outputs), 1, tape);
+}
+
+xt::xarray<xt::xarray<float>> nn::ModelBase::get_gradient(xt::xarray<float> outputs, xt::xarray<float> deltas, Tape& tape) const
 {
 	nn::GradientMap gradient_map;
-	backward(outputs, 1, tape, gradient_map);
+	backward(outputs, std::move(deltas), tape, gradient_map);
 	auto values = std::views::values(gradient_map);
 	std::vector<xt::xarray<float>> gradient{ values.begin(), values.end() };
 	return xt::adapt(gradient);
@@ -72,10 +79,62 @@ void nn::ModelBase::load_weights(const std::string filename) const
 		xt::from_json(w, *trainable_vars[weights_index]);
 		weights_index++;
 	}
+	trainable_vars_updated();
+}
+
+bool nn::ModelBase::save_weights_binary(const std::string filename) const
+{
+	const std::vector<xt::xarray<float>*> trainable_vars = get_trainable_vars_fixed();
+	return write_weights_file(filename, { trainable_vars.begin(), trainable_vars.end() });
+}
+
+bool nn::ModelBase::load_weights_binary(const std::string filename) const
+{
+	if (!read_weights_file(filename, get_trainable_vars_fixed()))
+		return false;
+	trainable_vars_updated();
+	return true;
+}
+
+bool nn::ModelBase::check_weights_binary(const std::string filename) const
+{
+	const std::vector<xt::xarray<float>*> trainable_vars = get_trainable_vars_fixed();
+	return check_weights_file(filename, { trainable_vars.begin(), trainable_vars.end() });
 }
 
 void nn::ModelBase::print_trainable_vars() const
 {
 	for (const auto& layer : layers)
 		layer->print_trainable_vars();
+}
+
+void nn::ModelBase::trainable_vars_updated() const
+{
+	for (const auto& layer : layers)
+		layer->trainable_vars_updated();
+}
+
+std::string nn::ModelBase::layer_group(std::size_t) const
+{
+	return "Model";
+}
+
+void nn::ModelBase::attach_profiler(Profiler& profiler, const std::string& prefix) const
+{
+	std::string previous_group;
+	std::size_t position = 0;
+	for (std::size_t layer_index = 0; layer_index < layers.size(); ++layer_index)
+	{
+		std::string group = prefix + layer_group(layer_index);
+		position = group == previous_group ? position + 1 : 0;
+		const std::size_t entry = profiler.add(group, group + "/" + std::to_string(position));
+		layers[layer_index]->set_profiler(&profiler, entry);
+		previous_group = std::move(group);
+	}
+}
+
+void nn::ModelBase::detach_profiler() const
+{
+	for (const auto& layer : layers)
+		layer->set_profiler(nullptr, 0);
 }
\ No newline at end of file
@@ -14,6 +14,7 @@ namespace nn
 	using TrainableVars = std::vector<xt::xarray<float>*>;
 
 	class Layer;
+	class Profiler;
 
 	class ModelBase
 	{
@@ -29,16 +30,34 @@ namespace nn
 			return layers.begin() + prev_size;
 		}
 
+		//name of the group a layer is reported under by the profiler, the whole model is a single group by default
+		virtual std::string layer_group(std::size_t layer_index) const;
+
 	public:
 		~ModelBase();
 
 		TrainableVars get_trainable_vars() const;
 		TrainableVars get_trainable_vars_fixed() const;
+		//json weights are meant for import and export
 		void save_weights(const std::string filename) const;
 		void load_weights(const std::string filename) const;
+		//binary weights are loaded from the memory mapping of the file without parsing, see WeightsFile.h
+		//returns false if the file could not be written completely
+		bool save_weights_binary(const std::string filename) const;
+		//returns false if the file is missing or does not match the model, the weights stay unchanged in that case
+		bool load_weights_binary(const std::string filename) const;
+		//returns whether load_weights_binary would succeed without changing the weights
+		bool check_weights_binary(const std::string filename) const;
 		void print_trainable_vars() const;
+		void trainable_vars_updated() const;
+		//every layer gets an entry named by its group and its position in the group, groups are prefixed with prefix
+		//the profiler must outlive the model or be detached before it is destroyed
+		void attach_profiler(Profiler& profiler, const std::string& prefix) const;
+		void detach_profiler() const;
 
 		xt::xarray<xt::xarray<float>> get_gradient(xt::xarray<float> outputs, Tape& tape) const;
+		//deltas of outputs are set explicitly, derivatives of different samples of the batch are summed weighted by them
+		xt::xarray<xt::xarray<float>> get_gradient(xt::xarray<float> outputs, xt::xarray<float> deltas, Tape& tape) const;
 
 		virtual void build(std::vector<std::size_t> input_shape) const;
 
@@ -0,0 +1,151 @@
+#include "neural_network/model/WeightsFile.h"
+#include "neural_network/utils/MappedFile.h"
+
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+
+namespace
+{
+	constexpr char weights_file_magic[8] = { 'D', 'Q', 'N', 'W', 'E', 'I', 'G', 'H' };
+	constexpr std::uint32_t weights_file_version = 1;
+	//files are written in the native byte order, a file from a machine with another one is rejected
+	constexpr std::uint32_t weights_file_byte_order = 0x01020304;
+	constexpr std::size_t max_dimensions = 8;
+
+	struct WeightsFileHeader
+	{
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t byte_order;
+		std::uint64_t tensors_number;
+		//checksum of the table of tensors
+		std::uint64_t table_checksum;
+	};
+
+	struct TensorEntry
+	{
+		std::uint64_t offset;
+		std::uint64_t size;
+		std::uint64_t dimensions;
+		std::uint64_t shape[max_dimensions];
+		std::uint64_t checksum;
+	};
+
+	//64-bit FNV-1a
+	std::uint64_t checksum(const unsigned char* data, std::size_t size)
+	{
+		std::uint64_t hash = 14695981039346656037ull;
+		for (std::size_t i = 0; i < size; ++i)
+			hash = (hash ^ data[i]) * 1099511628211ull;
+		return hash;
+	}
+
+	std::size_t aligned(std::size_t offset)
+	{
+		return (offset + nn::weights_file_alignment - 1) / nn::weights_file_alignment * nn::weights_file_alignment;
+	}
+
+	//returns an empty table if a tensor has more dimensions than an entry can hold
+	std::vector<TensorEntry> make_table(const std::vector<const xt::xarray<float>*>& tensors)
+	{
+		for (const auto* tensor : tensors)
+			if (tensor->dimension() > max_dimensions)
+				return {};
+		std::vector<TensorEntry> table(tensors.size());
+		std::size_t offset = aligned(sizeof(WeightsFileHeader) + tensors.size() * sizeof(TensorEntry));
+		for (std::size_t i = 0; i < tensors.size(); ++i)
+		{
+			const auto& tensor = *tensors[i];
+			TensorEntry& entry = table[i];
+			entry.offset = offset;
+			entry.size = tensor.size();
+			entry.dimensions = tensor.dimension();
+			std::copy(tensor.shape().begin(), tensor.shape().end(), entry.shape);
+			entry.checksum = checksum(reinterpret_cast<const unsigned char*>(tensor.data()), tensor.size() * sizeof(float));
+			offset = aligned(offset + tensor.size() * sizeof(float));
+		}
+		return table;
+	}
+
+	//returns the mapping of the file if it has the layout of tensors and every checksum is right
+	std::unique_ptr<nn::MappedFile> open_checked(const std::string& filename,
+		const std::vector<const xt::xarray<float>*>& tensors, std::vector<TensorEntry>& table)
+	{
+		auto file = std::make_unique<nn::MappedFile>(filename);
+		if (!file->is_open() || file->size() < sizeof(WeightsFileHeader))
+			return nullptr;
+		WeightsFileHeader header;
+		std::memcpy(&header, file->data(), sizeof(header));
+		if (!std::equal(std::begin(weights_file_magic), std::end(weights_file_magic), header.magic) ||
+			header.version != weights_file_version || header.byte_order != weights_file_byte_order ||
+			header.tensors_number != tensors.size() ||
+			file->size() < sizeof(WeightsFileHeader) + tensors.size() * sizeof(TensorEntry))
+			return nullptr;
+		table.resize(tensors.size());
+		std::memcpy(table.data(), file->data() + sizeof(WeightsFileHeader), table.size() * sizeof(TensorEntry));
+		if (checksum(reinterpret_cast<const unsigned char*>(table.data()), table.size() * sizeof(TensorEntry)) != header.table_checksum)
+			return nullptr;
+		for (std::size_t i = 0; i < tensors.size(); ++i)
+		{
+			const auto& tensor = *tensors[i];
+			const TensorEntry& entry = table[i];
+			if (entry.dimensions != tensor.dimension() || entry.size != tensor.size() ||
+				!std::equal(tensor.shape().begin(), tensor.shape().end(), entry.shape) ||
+				entry.offset % nn::weights_file_alignment != 0 || entry.offset + entry.size * sizeof(float) > file->size() ||
+				checksum(file->data() + entry.offset, entry.size * sizeof(float)) != entry.checksum)
+				return nullptr;
+		}
+		return file;
+	}
+}
+
+bool nn::write_weights_file(const std::string& filename, const std::vector<const xt::xarray<float>*>& tensors)
+{
+	const std::vector<TensorEntry> table = make_table(tensors);
+	if (table.size() != tensors.size())
+		return false;
+	WeightsFileHeader header{};
+	std::copy(std::begin(weights_file_magic), std::end(weights_file_magic), header.magic);
+	header.version = weights_file_version;
+	header.byte_order = weights_file_byte_order;
+	header.tensors_number = tensors.size();
+	header.table_checksum = checksum(reinterpret_cast<const unsigned char*>(table.data()), table.size() * sizeof(TensorEntry));
+
+	std::ofstream out_file(filename, std::ios::binary | std::ios::trunc);
+	const char padding[weights_file_alignment] = {};
+	std::size_t written = 0;
+	const auto write = [&](const void* data, std::size_t size) {
+		out_file.write(static_cast<const char*>(data), size);
+		written += size;
+	};
+	write(&header, sizeof(header));
+	write(table.data(), table.size() * sizeof(TensorEntry));
+	for (std::size_t i = 0; i < tensors.size(); ++i)
+	{
+		write(padding, table[i].offset - written);
+		write(tensors[i]->data(), tensors[i]->size() * sizeof(float));
+	}
+	out_file.close();
+	return out_file.good();
+}
+
+bool nn::check_weights_file(const std::string& filename, const std::vector<const xt::xarray<float>*>& tensors)
+{
+	std::vector<TensorEntry> table;
+	return open_checked(filename, tensors, table) != nullptr;
+}
+
+//everything is checked before the first tensor is changed
+bool nn::read_weights_file(const std::string& filename, const std::vector<xt::xarray<float>*>& tensors)
+{
+	std::vector<TensorEntry> table;
+	const auto file = open_checked(filename, { tensors.begin(), tensors.end() }, table);
+	if (!file)
+		return false;
+	for (std::size_t i = 0; i < tensors.size(); ++i)
+		std::memcpy(tensors[i]->data(), file->data() + table[i].offset, table[i].size * sizeof(float));
+	return true;
+}
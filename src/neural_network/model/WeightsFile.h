@@ -0,0 +1,25 @@
+#ifndef NEURALNETWORK_WEIGHTSFILE_H
+#define NEURALNETWORK_WEIGHTSFILE_H
+
+#include <vector>
+#include <string>
+#include <xtensor/containers/xarray.hpp>
+
+namespace nn
+{
+	//binary weights file:
+	//a header with the format version and the number of tensors, followed by a table with the shape (up to 8 dimensions),
+	//the offset and the checksum of every tensor, followed by raw floats of the tensors, every tensor starts at a multiple
+	//of weights_file_alignment bytes, so the file can be used right from its memory mapping
+	constexpr std::size_t weights_file_alignment = 64;
+
+	//returns false if the file could not be written completely or a tensor has more than 8 dimensions
+	bool write_weights_file(const std::string& filename, const std::vector<const xt::xarray<float>*>& tensors);
+	//the same checks as read_weights_file without changing tensors
+	bool check_weights_file(const std::string& filename, const std::vector<const xt::xarray<float>*>& tensors);
+	//fills tensors from the file, shapes are checked against the ones tensors already have
+	//returns false without changing anything if the file is missing, has another version or another layout, or is damaged
+	bool read_weights_file(const std::string& filename, const std::vector<xt::xarray<float>*>& tensors);
+}
+
+#endif
@@ -1,8 +1,10 @@
 #ifndef NEURALNETWORK_ACTIVATIONFUNCTIONS_H
 #define NEURALNETWORK_ACTIVATIONFUNCTIONS_H
 
-#include <xtensor/core/xvectorize.hpp>
-#include <cmath>
+#include <xtensor/containers/xarray.hpp>
+#include <xtensor/views/xbroadcast.hpp>
+#include <bit>
+#include <cstdint>
 
 namespace nn
 {
@@ -10,49 +12,110 @@ namespace nn
 	{
 		Identity,
 		Sigmoid,
-		Tanh
+		Tanh,
+		ReLU,
+		LeakyReLU
 	};
 
-	inline float identity_scalar(float input) { return input; }
-	inline float identity_derivative_scalar(float input) { return 1; }
-	inline float sigmoid_scalar(float input) { return 1 / (1 + std::exp(-input)); }
-	inline float sigmoid_derivative_scalar(float input) { return input * (1 - input); }
-	inline float tanh_scalar(float input) { return std::tanh(input); }
-	inline float tanh_derivative_scalar(float input) { return 1 - (float)pow(input, 2); }
+	//slope of leaky relu for negative inputs
+	constexpr float leaky_relu_slope = 0.01f;
 
-	inline const auto identity = xt::vectorize(identity_scalar);
-	inline const auto identity_derivative = xt::vectorize(identity_derivative_scalar);
-	inline const auto sigmoid = xt::vectorize(sigmoid_scalar);
-	inline const auto sigmoid_derivative = xt::vectorize(sigmoid_derivative_scalar);
-	inline const auto tanh = xt::vectorize(tanh_scalar);
-	inline const auto tanh_derivative = xt::vectorize(tanh_derivative_scalar);
+	//activations are applied by the kernels below, which work on raw buffers and are inline and branch-free,
+	//so the compiler vectorises their loops
 
-	template<class E>
-	auto activate(E&& input, Activation activation)
+	//exp(x) = 2^n * exp(r), where n = round(x / ln2) and |r| <= ln2 / 2
+	//exp(r) is approximated by a polynomial, relative error is below 2e-7 over the whole clamped range
+	inline float fast_exp(float input)
+	{
+		constexpr float log2e = 1.44269504f;
+		//ln2 split into a part exactly representable with few bits and a remainder, so that r is computed exactly
+		constexpr float ln2_high = 0.693359375f;
+		constexpr float ln2_low = -2.12194440e-4f;
+		//adding and subtracting 1.5 * 2^23 rounds to the nearest integer without a library call
+		constexpr float round_magic = 12582912.0f;
+		const float clamped = input < -87.0f ? -87.0f : input;
+		const float x = clamped > 88.0f ? 88.0f : clamped;
+		const float n = (x * log2e + round_magic) - round_magic;
+		const float r = (x - n * ln2_high) - n * ln2_low;
+		float p = 1.9875691500e-4f;
+		p = p * r + 1.3981999507e-3f;
+		p = p * r + 8.3334519073e-3f;
+		p = p * r + 4.1665795894e-2f;
+		p = p * r + 1.6666665459e-1f;
+		p = p * r + 5.0000001201e-1f;
+		p = p * r * r + r + 1.0f;
+		const float scale = std::bit_cast<float>((static_cast<std::int32_t>(n) + 127) << 23);
+		return p * scale;
+	}
+	inline float fast_sigmoid(float input) { return 1 / (1 + fast_exp(-input)); }
+	//tanh(x) = 2 * sigmoid(2x) - 1, absolute error stays below 1e-6
+	inline float fast_tanh(float input) { return 2 / (1 + fast_exp(-2 * input)) - 1; }
+
+	template<class Function>
+	void bias_apply(float* data, const float* biases, std::size_t rows, std::size_t cols, Function function)
+	{
+		for (std::size_t r = 0; r < rows; ++r, data += cols)
+			for (std::size_t c = 0; c < cols; ++c)
+				data[c] = function(data[c] + biases[c]);
+	}
+
+	//data[r][c] = activation(data[r][c] + biases[c]) in a single pass, data has rows of cols elements
+	inline void bias_activate(float* data, const float* biases, std::size_t rows, std::size_t cols, Activation activation)
 	{
 		switch (activation)
 		{
 		case Activation::Sigmoid:
-			return sigmoid(std::forward<E>(input));
+			return bias_apply(data, biases, rows, cols, fast_sigmoid);
 		case Activation::Tanh:
-			return tanh(std::forward<E>(input));
+			return bias_apply(data, biases, rows, cols, fast_tanh);
+		case Activation::ReLU:
+			return bias_apply(data, biases, rows, cols, [](float x) { return x > 0 ? x : 0.0f; });
+		case Activation::LeakyReLU:
+			return bias_apply(data, biases, rows, cols, [](float x) { return x > 0 ? x : leaky_relu_slope * x; });
 		default:
-			return identity(std::forward<E>(input));
+			return bias_apply(data, biases, rows, cols, [](float x) { return x; });
 		}
 	}
-	template<class E>
-	auto derive(E&& input, Activation activation)
+
+	//biases are applied along the last axis
+	inline void bias_activate(xt::xarray<float>& data, const xt::xarray<float>& biases, Activation activation)
+	{
+		const std::size_t cols = biases.size();
+		bias_activate(data.data(), biases.data(), data.size() / cols, cols, activation);
+	}
+
+	template<class Function>
+	void derive_apply(float* deltas, const float* outputs, std::size_t size, Function function)
+	{
+		for (std::size_t i = 0; i < size; ++i)
+			deltas[i] *= function(outputs[i]);
+	}
+
+	//deltas *= derivative of the activation expressed through the activated outputs, in a single pass
+	inline void derive_multiply(float* deltas, const float* outputs, std::size_t size, Activation activation)
 	{
 		switch (activation)
 		{
 		case Activation::Sigmoid:
-			return sigmoid_derivative(std::forward<E>(input));
+			return derive_apply(deltas, outputs, size, [](float y) { return y * (1 - y); });
 		case Activation::Tanh:
-			return tanh_derivative(std::forward<E>(input));
+			return derive_apply(deltas, outputs, size, [](float y) { return 1 - y * y; });
+		case Activation::ReLU:
+			return derive_apply(deltas, outputs, size, [](float y) { return y > 0 ? 1.0f : 0.0f; });
+		case Activation::LeakyReLU:
+			return derive_apply(deltas, outputs, size, [](float y) { return y > 0 ? 1.0f : leaky_relu_slope; });
 		default:
-			return identity_derivative(std::forward<E>(input));
+			return;
 		}
 	}
+
+	//deltas that are broadcast to outputs (such as the initial scalar deltas of a model) are expanded first
+	inline void derive_multiply(xt::xarray<float>& deltas, const xt::xarray<float>& outputs, Activation activation)
+	{
+		if (deltas.shape() != outputs.shape())
+			deltas = xt::broadcast(deltas, outputs.shape());
+		derive_multiply(deltas.data(), outputs.data(), outputs.size(), activation);
+	}
 }
 
 #endif
\ No newline at end of file
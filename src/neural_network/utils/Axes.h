@@ -0,0 +1,14 @@
+#ifndef NEURALNETWORK_AXES_H
+#define NEURALNETWORK_AXES_H
+
+namespace nn
+{
+	using Axis = int;
+
+	//axes of images, which have (batch, height, width, channels) layout
+	const Axis height_axis = 1;
+	const Axis width_axis = 2;
+	const Axis channels_axis = 3;
+}
+
+#endif
@@ -1,17 +1,16 @@
 #ifndef NEURALNETWORK_CONVOLUTEFUNCTIONS_H
 #define NEURALNETWORK_CONVOLUTEFUNCTIONS_H
 
+#include "neural_network/utils/Axes.h"
+#include "neural_network/utils/GemmFunctions.h"
+
 #include <xtensor/views/xview.hpp>
 #include <xtensor/generators/xbuilder.hpp>
+#include <algorithm>
 
 namespace nn
 {
-    using Axis = int;
-
-    const Axis height_axis = 1;
-    const Axis width_axis = 2;
-    const Axis channels_axis = 3;
-
+    //reference implementation, kept to check faster convolution paths against
     template<class I, class F, class S>
     auto convolute2D(const I& inputs, const F& filters, const S& outputs_shape)
     {
@@ -29,6 +28,192 @@ namespace nn
             }
         return outputs;
     }
+
+    //number of output pixels processed at once by convolute2D_gemm
+    //the patch matrix of a chunk is expected to stay in cache while it is multiplied by filters
+    const std::size_t im2col_chunk_size = 128;
+
+    //copies the patch of inputs for the output pixel (b, i, k) into a row of a patch matrix
+    //the row has kernel_height * kernel_width * channels elements which is the layout of a single filter
+    //inputs are implicitly padded with pad_top rows and pad_left columns of zeros, the patch of (i, k)
+    //starts at (i - pad_top, k - pad_left), the part of the patch outside of the inputs is zeroed
+    inline void im2col_patch(const float* inputs, const std::vector<std::size_t>& inputs_shape, std::size_t kernel_height,
+        std::size_t kernel_width, std::size_t pad_top, std::size_t pad_left, std::size_t b, std::size_t i, std::size_t k,
+        float* patch)
+    {
+        const std::size_t inputs_height = inputs_shape[height_axis];
+        const std::size_t inputs_width = inputs_shape[width_axis];
+        const std::size_t channels = inputs_shape[channels_axis];
+        //for every kernel row the patch is a contiguous run of kernel_width * channels elements
+        const std::size_t run = kernel_width * channels;
+        const float* image = inputs + b * inputs_height * inputs_width * channels;
+        //interior windows are copied run by run without any checks
+        if (i >= pad_top && k >= pad_left && i - pad_top + kernel_height <= inputs_height &&
+            k - pad_left + kernel_width <= inputs_width)
+        {
+            const float* window = image + ((i - pad_top) * inputs_width + k - pad_left) * channels;
+            for (std::size_t u = 0; u < kernel_height; ++u)
+            {
+                std::copy_n(window, run, patch);
+                window += inputs_width * channels;
+                patch += run;
+            }
+            return;
+        }
+        //for border windows the columns inside of the inputs are the same for every kernel row
+        const std::ptrdiff_t row = (std::ptrdiff_t)i - (std::ptrdiff_t)pad_top;
+        const std::ptrdiff_t col = (std::ptrdiff_t)k - (std::ptrdiff_t)pad_left;
+        const std::size_t v_begin = (std::size_t)std::clamp<std::ptrdiff_t>(-col, 0, kernel_width);
+        const std::size_t v_end = (std::size_t)std::clamp<std::ptrdiff_t>((std::ptrdiff_t)inputs_width - col, v_begin, kernel_width);
+        for (std::size_t u = 0; u < kernel_height; ++u, patch += run)
+        {
+            const std::ptrdiff_t inputs_row = row + (std::ptrdiff_t)u;
+            if (inputs_row < 0 || inputs_row >= (std::ptrdiff_t)inputs_height || v_begin == v_end)
+            {
+                std::fill_n(patch, run, 0.0f);
+                continue;
+            }
+            std::fill_n(patch, v_begin * channels, 0.0f);
+            std::copy_n(image + (inputs_row * inputs_width + col + v_begin) * channels, (v_end - v_begin) * channels,
+                patch + v_begin * channels);
+            std::fill_n(patch + v_end * channels, (kernel_width - v_end) * channels, 0.0f);
+        }
+    }
+
+    //copies patches of inputs for output pixels [pixel_begin, pixel_begin + pixels) into rows of a patch matrix
+    //inputs have (batch, height, width, channels) layout, pixels are counted over batch, output height and output width
+    inline void im2col(const float* inputs, const std::vector<std::size_t>& inputs_shape, std::size_t kernel_height,
+        std::size_t kernel_width, std::size_t pad_top, std::size_t pad_left, std::size_t outputs_height,
+        std::size_t outputs_width, std::size_t pixel_begin, std::size_t pixels, float* patches)
+    {
+        const std::size_t patch_size = kernel_height * kernel_width * inputs_shape[channels_axis];
+        for (std::size_t pixel = pixel_begin; pixel < pixel_begin + pixels; ++pixel, patches += patch_size)
+            im2col_patch(inputs, inputs_shape, kernel_height, kernel_width, pad_top, pad_left,
+                pixel / outputs_width / outputs_height, pixel / outputs_width % outputs_height, pixel % outputs_width, patches);
+    }
+
+    //convolution as a product of the patch matrix of inputs and the transposed filters matrix
+    //result has the same layout as convolute2D: filters number becomes the channels number
+    //inputs are implicitly padded as described for im2col_patch, so no padded copy of them is made
+    template<class S>
+    auto convolute2D_gemm(const xt::xarray<float>& inputs, const xt::xarray<float>& filters, const S& outputs_shape,
+        std::size_t pad_top = 0, std::size_t pad_left = 0)
+    {
+        auto outputs = xt::xarray<float>::from_shape(outputs_shape);
+        const std::vector<std::size_t> inputs_shape(inputs.shape().begin(), inputs.shape().end());
+        const std::size_t kernel_height = filters.shape()[height_axis];
+        const std::size_t kernel_width = filters.shape()[width_axis];
+        const std::size_t filters_number = filters.shape()[0];
+        const std::size_t patch_size = kernel_height * kernel_width * inputs_shape[channels_axis];
+        const std::size_t outputs_height = outputs_shape[height_axis];
+        const std::size_t outputs_width = outputs_shape[width_axis];
+        const std::size_t pixels_total = outputs_shape[0] * outputs_height * outputs_width;
+
+        //filters are stored as filters_number x patch_size, so the transposed matrix is read without copying
+        const MatrixView filters_matrix = row_major(filters.data(), patch_size).transposed();
+        thread_local std::vector<float> patches;
+        patches.resize(std::min(pixels_total, im2col_chunk_size) * patch_size);
+        for (std::size_t pixel = 0; pixel < pixels_total; pixel += im2col_chunk_size)
+        {
+            const std::size_t pixels = std::min(im2col_chunk_size, pixels_total - pixel);
+            im2col(inputs.data(), inputs_shape, kernel_height, kernel_width, pad_top, pad_left, outputs_height, outputs_width,
+                pixel, pixels, patches.data());
+            gemm(pixels, filters_number, patch_size, row_major(patches.data(), patch_size), filters_matrix,
+                outputs.data() + pixel * filters_number, filters_number);
+        }
+        return outputs;
+    }
+
+    //adds a row of a patch matrix back to the inputs the patch was copied from by im2col_patch
+    //the part of the patch outside of the inputs belongs to the padding and is dropped
+    inline void col2im_patch(const float* patch, const std::vector<std::size_t>& inputs_shape, std::size_t kernel_height,
+        std::size_t kernel_width, std::size_t pad_top, std::size_t pad_left, std::size_t b, std::size_t i, std::size_t k,
+        float* inputs)
+    {
+        const std::size_t inputs_height = inputs_shape[height_axis];
+        const std::size_t inputs_width = inputs_shape[width_axis];
+        const std::size_t channels = inputs_shape[channels_axis];
+        const std::size_t run = kernel_width * channels;
+        float* image = inputs + b * inputs_height * inputs_width * channels;
+        const std::ptrdiff_t row = (std::ptrdiff_t)i - (std::ptrdiff_t)pad_top;
+        const std::ptrdiff_t col = (std::ptrdiff_t)k - (std::ptrdiff_t)pad_left;
+        const std::size_t v_begin = (std::size_t)std::clamp<std::ptrdiff_t>(-col, 0, kernel_width);
+        const std::size_t v_end = (std::size_t)std::clamp<std::ptrdiff_t>((std::ptrdiff_t)inputs_width - col, v_begin, kernel_width);
+        const std::size_t added = (v_end - v_begin) * channels;
+        for (std::size_t u = 0; u < kernel_height; ++u, patch += run)
+        {
+            const std::ptrdiff_t inputs_row = row + (std::ptrdiff_t)u;
+            if (inputs_row < 0 || inputs_row >= (std::ptrdiff_t)inputs_height)
+                continue;
+            float* window = image + (inputs_row * inputs_width + col + v_begin) * channels;
+            const float* src = patch + v_begin * channels;
+            for (std::size_t j = 0; j < added; ++j)
+                window[j] += src[j];
+        }
+    }
+
+    //derivative of convolute2D_gemm by filters: patches of inputs transposed times deltas of outputs,
+    //which as a matrix is deltas^T * patches, filters_number x patch_size, so it comes out in the layout of filters
+    //the sum over pixels is the inner dimension of the product and runs chunk by chunk
+    template<class S>
+    auto convolute2D_filters_derivative(const xt::xarray<float>& inputs, const xt::xarray<float>& deltas,
+        const S& filters_shape, std::size_t pad_top = 0, std::size_t pad_left = 0)
+    {
+        auto derivative = xt::xarray<float>::from_shape(filters_shape);
+        const std::vector<std::size_t> inputs_shape(inputs.shape().begin(), inputs.shape().end());
+        const std::size_t kernel_height = filters_shape[height_axis];
+        const std::size_t kernel_width = filters_shape[width_axis];
+        const std::size_t filters_number = filters_shape[0];
+        const std::size_t patch_size = kernel_height * kernel_width * inputs_shape[channels_axis];
+        const std::size_t outputs_height = deltas.shape()[height_axis];
+        const std::size_t outputs_width = deltas.shape()[width_axis];
+        const std::size_t pixels_total = deltas.shape()[0] * outputs_height * outputs_width;
+
+        thread_local std::vector<float> patches;
+        patches.resize(std::min(pixels_total, im2col_chunk_size) * patch_size);
+        if (pixels_total == 0)
+            derivative.fill(0);
+        for (std::size_t pixel = 0; pixel < pixels_total; pixel += im2col_chunk_size)
+        {
+            const std::size_t pixels = std::min(im2col_chunk_size, pixels_total - pixel);
+            im2col(inputs.data(), inputs_shape, kernel_height, kernel_width, pad_top, pad_left, outputs_height, outputs_width,
+                pixel, pixels, patches.data());
+            gemm(filters_number, patch_size, pixels, row_major(deltas.data() + pixel * filters_number, filters_number).transposed(),
+                row_major(patches.data(), patch_size), derivative.data(), patch_size, pixel > 0);
+        }
+        return derivative;
+    }
+
+    //derivative of convolute2D_gemm by inputs: every output pixel sends deltas * filters back to its patch
+    //rows of deltas times the filters matrix are patches of derivatives, which col2im adds to where they came from
+    template<class S>
+    auto convolute2D_inputs_derivative(const xt::xarray<float>& deltas, const xt::xarray<float>& filters,
+        const S& inputs_shape, std::size_t pad_top = 0, std::size_t pad_left = 0)
+    {
+        xt::xarray<float> derivative = xt::zeros<float>(inputs_shape);
+        const std::vector<std::size_t> shape(inputs_shape.begin(), inputs_shape.end());
+        const std::size_t kernel_height = filters.shape()[height_axis];
+        const std::size_t kernel_width = filters.shape()[width_axis];
+        const std::size_t filters_number = filters.shape()[0];
+        const std::size_t patch_size = kernel_height * kernel_width * shape[channels_axis];
+        const std::size_t outputs_height = deltas.shape()[height_axis];
+        const std::size_t outputs_width = deltas.shape()[width_axis];
+        const std::size_t pixels_total = deltas.shape()[0] * outputs_height * outputs_width;
+
+        thread_local std::vector<float> patches;
+        patches.resize(std::min(pixels_total, im2col_chunk_size) * patch_size);
+        for (std::size_t pixel = 0; pixel < pixels_total; pixel += im2col_chunk_size)
+        {
+            const std::size_t pixels = std::min(im2col_chunk_size, pixels_total - pixel);
+            gemm(pixels, patch_size, filters_number, row_major(deltas.data() + pixel * filters_number, filters_number),
+                row_major(filters.data(), patch_size), patches.data(), patch_size);
+            const float* patch = patches.data();
+            for (std::size_t p = pixel; p < pixel + pixels; ++p, patch += patch_size)
+                col2im_patch(patch, shape, kernel_height, kernel_width, pad_top, pad_left,
+                    p / outputs_width / outputs_height, p / outputs_width % outputs_height, p % outputs_width, derivative.data());
+        }
+        return derivative;
+    }
 }
 
 #endif
\ No newline at end of file
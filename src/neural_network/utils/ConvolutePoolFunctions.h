@@ -0,0 +1,137 @@
+#ifndef NEURALNETWORK_CONVOLUTEPOOLFUNCTIONS_H
+#define NEURALNETWORK_CONVOLUTEPOOLFUNCTIONS_H
+
+#include "neural_network/utils/ConvoluteFunctions.h"
+#include "neural_network/utils/WinogradFunctions.h"
+#include "neural_network/utils/PoolFunctions.h"
+
+namespace nn
+{
+    //convolution immediately followed by max pooling, convolution outputs are reduced to their maximums
+    //as soon as they are computed, so the full convolution outputs never exist
+    //inputs are padded as in convolute2D_gemm, switches are as in maxpool2D, switches index the (batch, conv_height, conv_width, filters) convolution outputs
+
+    //number of pooling windows processed at once by convolute2D_maxpool2D_gemm
+    const std::size_t conv_pool_chunk_size = 32;
+
+    //the patch matrix holds all pool_height * pool_width patches of every window of a chunk
+    //positions of windows cut by the borders of convolution outputs repeat the top left pixel of the window,
+    //which does not change the maximum, so every window is reduced the same way
+    template<class S>
+    auto convolute2D_maxpool2D_gemm(const xt::xarray<float>& inputs, const xt::xarray<float>& filters,
+        std::size_t pad_top, std::size_t pad_left, std::size_t conv_height, std::size_t conv_width, PoolSize pool_size,
+        const S& outputs_shape, std::size_t* switches)
+    {
+        auto outputs = xt::xarray<float>::from_shape(outputs_shape);
+        auto& [pool_height, pool_width] = pool_size;
+        const std::vector<std::size_t> inputs_shape(inputs.shape().begin(), inputs.shape().end());
+        const std::size_t kernel_height = filters.shape()[height_axis];
+        const std::size_t kernel_width = filters.shape()[width_axis];
+        const std::size_t filters_number = filters.shape()[0];
+        const std::size_t patch_size = kernel_height * kernel_width * inputs_shape[channels_axis];
+        const std::size_t window_size = pool_height * pool_width;
+        const std::size_t outputs_height = outputs_shape[height_axis];
+        const std::size_t outputs_width = outputs_shape[width_axis];
+        const std::size_t windows_total = outputs_shape[0] * outputs_height * outputs_width;
+
+        const MatrixView filters_matrix = row_major(filters.data(), patch_size).transposed();
+        thread_local std::vector<float> patches;
+        thread_local std::vector<float> conv_outputs;
+        const std::size_t chunk = std::min(windows_total, conv_pool_chunk_size);
+        patches.resize(chunk * window_size * patch_size);
+        conv_outputs.resize(chunk * window_size * filters_number);
+        float* pooled = outputs.data();
+        for (std::size_t window_begin = 0; window_begin < windows_total; window_begin += chunk)
+        {
+            const std::size_t windows = std::min(chunk, windows_total - window_begin);
+            float* patch = patches.data();
+            for (std::size_t window = window_begin; window < window_begin + windows; ++window)
+            {
+                const std::size_t i_start = window / outputs_width % outputs_height * pool_height;
+                const std::size_t k_start = window % outputs_width * pool_width;
+                const std::size_t b = window / outputs_width / outputs_height;
+                for (std::size_t u = 0; u < pool_height; ++u)
+                    for (std::size_t v = 0; v < pool_width; ++v, patch += patch_size)
+                    {
+                        const bool inside = i_start + u < conv_height && k_start + v < conv_width;
+                        im2col_patch(inputs.data(), inputs_shape, kernel_height, kernel_width, pad_top, pad_left, b,
+                            inside ? i_start + u : i_start, inside ? k_start + v : k_start, patch);
+                    }
+            }
+            gemm(windows * window_size, filters_number, patch_size, row_major(patches.data(), patch_size),
+                filters_matrix, conv_outputs.data(), filters_number);
+
+            const float* conv_pixel = conv_outputs.data();
+            for (std::size_t window = window_begin; window < window_begin + windows; ++window, pooled += filters_number)
+            {
+                std::copy_n(conv_pixel, filters_number, pooled);
+                if (!switches)
+                {
+                    conv_pixel += filters_number;
+                    for (std::size_t position = 1; position < window_size; ++position, conv_pixel += filters_number)
+                        for (std::size_t f = 0; f < filters_number; ++f)
+                            pooled[f] = std::max(pooled[f], conv_pixel[f]);
+                    continue;
+                }
+                //the position of the maximum inside of the window is turned into a flat index of convolution outputs
+                const std::size_t i_start = window / outputs_width % outputs_height * pool_height;
+                const std::size_t k_start = window % outputs_width * pool_width;
+                const std::size_t b = window / outputs_width / outputs_height;
+                const std::size_t first = ((b * conv_height + i_start) * conv_width + k_start) * filters_number;
+                for (std::size_t f = 0; f < filters_number; ++f)
+                    switches[f] = first + f;
+                conv_pixel += filters_number;
+                for (std::size_t position = 1; position < window_size; ++position, conv_pixel += filters_number)
+                {
+                    const std::size_t u = position / pool_width;
+                    const std::size_t v = position % pool_width;
+                    const std::size_t pixel = ((b * conv_height + i_start + u) * conv_width + k_start + v) * filters_number;
+                    for (std::size_t f = 0; f < filters_number; ++f)
+                        if (conv_pixel[f] > pooled[f])
+                        {
+                            pooled[f] = conv_pixel[f];
+                            switches[f] = pixel + f;
+                        }
+                }
+                switches += filters_number;
+            }
+        }
+        return outputs;
+    }
+
+    //for 2x2 pooling every 2x2 output tile of Winograd convolution is exactly one pooling window,
+    //so the maximum is taken right after the inverse transform of the tile
+    template<class S>
+    auto convolute2D_maxpool2D_winograd(const xt::xarray<float>& inputs, const std::vector<float>& transformed_filters,
+        std::size_t pad_top, std::size_t pad_left, std::size_t conv_height, std::size_t conv_width, const S& outputs_shape,
+        std::size_t* switches)
+    {
+        using gemm_blocking::nr;
+        auto outputs = xt::xarray<float>::from_shape(outputs_shape);
+        const std::size_t outputs_height = outputs_shape[height_axis];
+        const std::size_t outputs_width = outputs_shape[width_axis];
+        const std::size_t filters_number = outputs_shape[channels_axis];
+        const std::vector<std::size_t> conv_shape = { outputs_shape[0], conv_height, conv_width, filters_number };
+        winograd_convolute(inputs, transformed_filters, conv_shape, pad_top, pad_left,
+            [&](std::size_t b, std::size_t i, std::size_t k, std::size_t f, const float* y) {
+                const std::size_t pooled = ((b * outputs_height + i / 2) * outputs_width + k / 2) * filters_number + f;
+                float max = y[0];
+                std::size_t max_u = 0;
+                std::size_t max_v = 0;
+                for (std::size_t u = 0; u < std::min<std::size_t>(2, conv_height - i); ++u)
+                    for (std::size_t v = 0; v < std::min<std::size_t>(2, conv_width - k); ++v)
+                        if (y[(u * 2 + v) * nr] > max)
+                        {
+                            max = y[(u * 2 + v) * nr];
+                            max_u = u;
+                            max_v = v;
+                        }
+                outputs.data()[pooled] = max;
+                if (switches)
+                    switches[pooled] = ((b * conv_height + i + max_u) * conv_width + k + max_v) * filters_number + f;
+            });
+        return outputs;
+    }
+}
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef NEURALNETWORK_GEMMFUNCTIONS_H
+#define NEURALNETWORK_GEMMFUNCTIONS_H
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+namespace nn
+{
+	//read-only matrix over raw memory, element (r, c) is data[r * row_stride + c * col_stride]
+	//strides allow transposed operands to be passed without copying them
+	struct MatrixView
+	{
+		const float* data;
+		std::size_t row_stride;
+		std::size_t col_stride;
+
+		float operator()(std::size_t r, std::size_t c) const { return data[r * row_stride + c * col_stride]; }
+		MatrixView transposed() const { return { data, col_stride, row_stride }; }
+	};
+
+	//row-major matrix with rows of the given length
+	inline MatrixView row_major(const float* data, std::size_t cols) { return { data, cols, 1 }; }
+
+	namespace gemm_blocking
+	{
+		//register block of the micro kernel, accumulators must fit into vector registers
+		constexpr std::size_t mr = 4;
+		constexpr std::size_t nr = 8;
+		//cache blocks: a mc x kc block of A stays in L2, a kc x nc block of B stays in L3
+		constexpr std::size_t mc = 72;
+		constexpr std::size_t kc = 256;
+		constexpr std::size_t nc = 1024;
+	}
+
+	//packs a block of A into panels of mr rows, panel layout is [k][mr], missing rows are zeroed
+	inline void gemm_pack_a(MatrixView a, std::size_t row_begin, std::size_t rows, std::size_t k_begin, std::size_t depth,
+		float* packed)
+	{
+		using gemm_blocking::mr;
+		for (std::size_t panel = 0; panel < rows; panel += mr)
+		{
+			const std::size_t panel_rows = std::min(mr, rows - panel);
+			for (std::size_t p = 0; p < depth; ++p)
+			{
+				std::size_t i = 0;
+				for (; i < panel_rows; ++i)
+					packed[i] = a(row_begin + panel + i, k_begin + p);
+				for (; i < mr; ++i)
+					packed[i] = 0;
+				packed += mr;
+			}
+		}
+	}
+
+	//packs a block of B into panels of nr columns, panel layout is [k][nr], missing columns are zeroed
+	inline void gemm_pack_b(MatrixView b, std::size_t k_begin, std::size_t depth, std::size_t col_begin, std::size_t cols,
+		float* packed)
+	{
+		using gemm_blocking::nr;
+		for (std::size_t panel = 0; panel < cols; panel += nr)
+		{
+			const std::size_t panel_cols = std::min(nr, cols - panel);
+			for (std::size_t p = 0; p < depth; ++p)
+			{
+				if (b.col_stride == 1 && panel_cols == nr)
+					std::copy_n(b.data + (k_begin + p) * b.row_stride + col_begin + panel, nr, packed);
+				else
+				{
+					std::size_t j = 0;
+					for (; j < panel_cols; ++j)
+						packed[j] = b(k_begin + p, col_begin + panel + j);
+					for (; j < nr; ++j)
+						packed[j] = 0;
+				}
+				packed += nr;
+			}
+		}
+	}
+
+	//computes a mr x nr tile of C from packed panels, the inner loops have constant trip counts
+	//so that the compiler keeps the accumulators in vector registers
+	inline void gemm_micro_kernel(std::size_t depth, const float* a_panel, const float* b_panel,
+		float* c, std::size_t ldc, std::size_t rows, std::size_t cols, bool accumulate)
+	{
+		using gemm_blocking::mr;
+		using gemm_blocking::nr;
+		float acc[mr][nr] = {};
+		for (std::size_t p = 0; p < depth; ++p)
+		{
+			const float* a_col = a_panel + p * mr;
+			const float* b_row = b_panel + p * nr;
+			for (std::size_t i = 0; i < mr; ++i)
+				for (std::size_t j = 0; j < nr; ++j)
+					acc[i][j] += a_col[i] * b_row[j];
+		}
+		for (std::size_t i = 0; i < rows; ++i)
+		{
+			float* c_row = c + i * ldc;
+			if (accumulate)
+				for (std::size_t j = 0; j < cols; ++j)
+					c_row[j] += acc[i][j];
+			else
+				for (std::size_t j = 0; j < cols; ++j)
+					c_row[j] = acc[i][j];
+		}
+	}
+
+	//dot product of contiguous vectors, partial sums are kept in independent lanes so that the loop is vectorised
+	//without reassociating a single sum
+	inline float dot(const float* x, const float* y, std::size_t size)
+	{
+		constexpr std::size_t lanes = 8;
+		float acc[lanes] = {};
+		std::size_t i = 0;
+		for (; i + lanes <= size; i += lanes)
+			for (std::size_t j = 0; j < lanes; ++j)
+				acc[j] += x[i + j] * y[i + j];
+		float sum = 0;
+		for (; i < size; ++i)
+			sum += x[i] * y[i];
+		for (std::size_t j = 0; j < lanes; ++j)
+			sum += acc[j];
+		return sum;
+	}
+
+	//y += alpha * x for contiguous vectors
+	inline void axpy(float alpha, const float* x, float* y, std::size_t size)
+	{
+		for (std::size_t i = 0; i < size; ++i)
+			y[i] += alpha * x[i];
+	}
+
+	//c = a * B for a single row a, or c += a * B if accumulate is set
+	//B is read either by contiguous columns (dot products) or by contiguous rows (axpy updates)
+	//returns false if B has neither layout
+	inline bool gemv(std::size_t n, std::size_t k, MatrixView a, MatrixView b, float* c, bool accumulate)
+	{
+		thread_local std::vector<float> row;
+		const float* a_row = a.data;
+		if (a.col_stride != 1)
+		{
+			row.resize(k);
+			for (std::size_t p = 0; p < k; ++p)
+				row[p] = a(0, p);
+			a_row = row.data();
+		}
+		if (b.row_stride == 1)
+		{
+			for (std::size_t j = 0; j < n; ++j)
+				c[j] = (accumulate ? c[j] : 0.0f) + dot(a_row, b.data + j * b.col_stride, k);
+			return true;
+		}
+		if (b.col_stride == 1)
+		{
+			if (!accumulate)
+				std::fill_n(c, n, 0.0f);
+			for (std::size_t p = 0; p < k; ++p)
+				axpy(a_row[p], b.data + p * b.row_stride, c, n);
+			return true;
+		}
+		return false;
+	}
+
+	//C = A * B, or C += A * B if accumulate is set
+	//A is m x k, B is k x n, C is row-major m x n with ldc elements between rows
+	inline void gemm(std::size_t m, std::size_t n, std::size_t k, MatrixView a, MatrixView b, float* c, std::size_t ldc,
+		bool accumulate = false)
+	{
+		using namespace gemm_blocking;
+		if (m == 0 || n == 0)
+			return;
+		if (k == 0)
+		{
+			if (!accumulate)
+				for (std::size_t i = 0; i < m; ++i)
+					std::fill_n(c + i * ldc, n, 0.0f);
+			return;
+		}
+		//a single row is not worth packing
+		if (m == 1 && gemv(n, k, a, b, c, accumulate))
+			return;
+		//packing buffers are reused between calls, each thread gets its own
+		thread_local std::vector<float> packed_a;
+		thread_local std::vector<float> packed_b;
+		packed_a.resize(((std::min(m, mc) + mr - 1) / mr) * mr * kc);
+		packed_b.resize(((std::min(n, nc) + nr - 1) / nr) * nr * kc);
+
+		for (std::size_t jc = 0; jc < n; jc += nc)
+		{
+			const std::size_t cols = std::min(nc, n - jc);
+			for (std::size_t pc = 0; pc < k; pc += kc)
+			{
+				const std::size_t depth = std::min(kc, k - pc);
+				const bool accumulate_block = accumulate || pc > 0;
+				gemm_pack_b(b, pc, depth, jc, cols, packed_b.data());
+				for (std::size_t ic = 0; ic < m; ic += mc)
+				{
+					const std::size_t rows = std::min(mc, m - ic);
+					gemm_pack_a(a, ic, rows, pc, depth, packed_a.data());
+					for (std::size_t jr = 0; jr < cols; jr += nr)
+						for (std::size_t ir = 0; ir < rows; ir += mr)
+							gemm_micro_kernel(depth, packed_a.data() + ir * depth, packed_b.data() + jr * depth,
+								c + (ic + ir) * ldc + jc + jr, ldc, std::min(mr, rows - ir), std::min(nr, cols - jr),
+								accumulate_block);
+				}
+			}
+		}
+	}
+}
+
+#endif
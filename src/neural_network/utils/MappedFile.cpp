@@ -0,0 +1,153 @@
+#include "neural_network/utils/MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+nn::MappedFile::MappedFile(const std::string& filename)
+{
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+	file_handle = file;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+	{
+		close();
+		return;
+	}
+	HANDLE file_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (file_mapping == nullptr)
+	{
+		close();
+		return;
+	}
+	//the view keeps the mapping alive, so its handle is not needed anymore
+	void* view = MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(file_mapping);
+	if (view == nullptr)
+	{
+		close();
+		return;
+	}
+	mapping = static_cast<unsigned char*>(view);
+	mapping_size = static_cast<std::size_t>(file_size.QuadPart);
+}
+
+nn::MappedFile::MappedFile(const std::string& filename, std::size_t size)
+{
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE || size == 0)
+	{
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		return;
+	}
+	file_handle = file;
+	//the mapping cannot make the file shorter, so its end is set explicitly
+	LARGE_INTEGER file_size;
+	file_size.QuadPart = static_cast<LONGLONG>(size);
+	if (!SetFilePointerEx(file, file_size, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+	{
+		close();
+		return;
+	}
+	HANDLE file_mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, file_size.HighPart, file_size.LowPart, nullptr);
+	if (file_mapping == nullptr)
+	{
+		close();
+		return;
+	}
+	void* view = MapViewOfFile(file_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	CloseHandle(file_mapping);
+	if (view == nullptr)
+	{
+		close();
+		return;
+	}
+	mapping = static_cast<unsigned char*>(view);
+	mapping_size = size;
+}
+
+void nn::MappedFile::close()
+{
+	if (mapping != nullptr)
+		UnmapViewOfFile(mapping);
+	if (file_handle != nullptr)
+		CloseHandle(file_handle);
+	mapping = nullptr;
+	mapping_size = 0;
+	file_handle = nullptr;
+}
+
+#else
+
+nn::MappedFile::MappedFile(const std::string& filename)
+{
+	file_descriptor = ::open(filename.c_str(), O_RDONLY);
+	if (file_descriptor < 0)
+		return;
+	struct stat file_status;
+	if (fstat(file_descriptor, &file_status) != 0 || file_status.st_size == 0)
+	{
+		close();
+		return;
+	}
+	void* view = mmap(nullptr, static_cast<std::size_t>(file_status.st_size), PROT_READ, MAP_SHARED, file_descriptor, 0);
+	if (view == MAP_FAILED)
+	{
+		close();
+		return;
+	}
+	mapping = static_cast<unsigned char*>(view);
+	mapping_size = static_cast<std::size_t>(file_status.st_size);
+}
+
+nn::MappedFile::MappedFile(const std::string& filename, std::size_t size)
+{
+	file_descriptor = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+	if (file_descriptor < 0)
+		return;
+	if (size == 0 || ftruncate(file_descriptor, static_cast<off_t>(size)) != 0)
+	{
+		close();
+		return;
+	}
+	void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+	if (view == MAP_FAILED)
+	{
+		close();
+		return;
+	}
+	mapping = static_cast<unsigned char*>(view);
+	mapping_size = size;
+}
+
+void nn::MappedFile::close()
+{
+	if (mapping != nullptr)
+		munmap(mapping, mapping_size);
+	if (file_descriptor >= 0)
+		::close(file_descriptor);
+	mapping = nullptr;
+	mapping_size = 0;
+	file_descriptor = -1;
+}
+
+#endif
+
+nn::MappedFile::~MappedFile()
+{
+	close();
+}
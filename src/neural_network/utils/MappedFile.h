@@ -0,0 +1,41 @@
+#ifndef NEURALNETWORK_MAPPEDFILE_H
+#define NEURALNETWORK_MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+namespace nn
+{
+	//file mapped into memory as a whole, the mapping starts at a page boundary
+	class MappedFile
+	{
+	private:
+		unsigned char* mapping = nullptr;
+		std::size_t mapping_size = 0;
+#ifdef _WIN32
+		void* file_handle = nullptr;
+#else
+		int file_descriptor = -1;
+#endif
+
+		void close();
+
+	public:
+		MappedFile() = default;
+		//maps an existing file for reading, the file is not open if it is missing or empty
+		explicit MappedFile(const std::string& filename);
+		//maps a file for reading and writing, the file is created if it is missing and resized to the given size,
+		//changes reach the file even if the process is killed
+		MappedFile(const std::string& filename, std::size_t size);
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool is_open() const { return mapping != nullptr; }
+		unsigned char* data() { return mapping; }
+		const unsigned char* data() const { return mapping; }
+		std::size_t size() const { return mapping_size; }
+	};
+}
+
+#endif
@@ -1,56 +1,90 @@
 #ifndef NEURALNETWORK_POOLFUNCTIONS_H
 #define NEURALNETWORK_POOLFUNCTIONS_H
 
-#include <xtensor/views/xview.hpp>
-#include <xtensor/views/xindex_view.hpp>
+#include "neural_network/utils/Axes.h"
+
+#include <xtensor/containers/xarray.hpp>
+#include <xtensor/generators/xbuilder.hpp>
+#include <algorithm>
+#include <vector>
 
 namespace nn
 {
-	using Axis = int;
 	using PoolSize = std::pair<std::size_t, std::size_t>;
 
-	const Axis height_axis = 1;
-	const Axis width_axis = 2;
-	const Axis channels_axis = 3;
-
-	template<class I, class S>
-	auto maxpool2D(const I& inputs, const S& outputs_shape, PoolSize pool_size)
+	//max over every pool_height x pool_width window of inputs with (batch, height, width, channels) layout
+	//windows at the bottom and right edges may be cut by the inputs borders
+	//the innermost loops run over contiguous channels, so the maximum is taken for all channels at once
+	//if switches is not null, the flat index of the first maximum of every window is written to it
+	inline void maxpool2D(const float* inputs, const std::vector<std::size_t>& inputs_shape, PoolSize pool_size,
+		float* outputs, std::size_t* switches)
 	{
 		auto& [pool_height, pool_width] = pool_size;
-		auto outputs = xt::xarray<float>::from_shape(outputs_shape);
-		for (std::size_t i = 0; i < outputs_shape[height_axis]; ++i)
-		{
-			const std::size_t inputs_i = i * pool_height;
-			for (std::size_t k = 0; k < outputs_shape[width_axis]; ++k)
+		const std::size_t batch_size = inputs_shape[0];
+		const std::size_t inputs_height = inputs_shape[height_axis];
+		const std::size_t inputs_width = inputs_shape[width_axis];
+		const std::size_t channels = inputs_shape[channels_axis];
+		const std::size_t outputs_height = (inputs_height - 1) / pool_height + 1;
+		const std::size_t outputs_width = (inputs_width - 1) / pool_width + 1;
+		for (std::size_t b = 0; b < batch_size; ++b)
+			for (std::size_t i = 0; i < outputs_height; ++i)
 			{
-				const std::size_t inputs_k = k * pool_width;
-				//pool is a part of input taken according to pool size
-				auto pool = xt::view(inputs, xt::all(), xt::range(inputs_i, inputs_i + pool_height),
-					xt::range(inputs_k, inputs_k + pool_width));
-				xt::view(outputs, xt::all(), i, k) = xt::amax(pool, { height_axis, width_axis });
+				const std::size_t i_start = i * pool_height;
+				const std::size_t i_end = std::min(i_start + pool_height, inputs_height);
+				for (std::size_t k = 0; k < outputs_width; ++k, outputs += channels)
+				{
+					const std::size_t k_start = k * pool_width;
+					const std::size_t k_end = std::min(k_start + pool_width, inputs_width);
+					const std::size_t first = ((b * inputs_height + i_start) * inputs_width + k_start) * channels;
+					std::copy_n(inputs + first, channels, outputs);
+					if (switches)
+						for (std::size_t c = 0; c < channels; ++c)
+							switches[c] = first + c;
+					for (std::size_t u = i_start; u < i_end; ++u)
+						for (std::size_t v = (u == i_start ? k_start + 1 : k_start); v < k_end; ++v)
+						{
+							const std::size_t pixel = ((b * inputs_height + u) * inputs_width + v) * channels;
+							const float* pixel_inputs = inputs + pixel;
+							if (switches)
+							{
+								for (std::size_t c = 0; c < channels; ++c)
+									if (pixel_inputs[c] > outputs[c])
+									{
+										outputs[c] = pixel_inputs[c];
+										switches[c] = pixel + c;
+									}
+							}
+							else
+								for (std::size_t c = 0; c < channels; ++c)
+									outputs[c] = std::max(outputs[c], pixel_inputs[c]);
+						}
+					if (switches)
+						switches += channels;
+				}
 			}
-		}
+	}
+
+	template<class S>
+	auto maxpool2D(const xt::xarray<float>& inputs, const S& outputs_shape, PoolSize pool_size,
+		std::vector<std::size_t>* switches = nullptr)
+	{
+		auto outputs = xt::xarray<float>::from_shape(outputs_shape);
+		const std::vector<std::size_t> inputs_shape(inputs.shape().begin(), inputs.shape().end());
+		if (switches)
+			switches->resize(outputs.size());
+		maxpool2D(inputs.data(), inputs_shape, pool_size, outputs.data(), switches ? switches->data() : nullptr);
 		return outputs;
 	}
 
-	template<class O, class D, class N>
-	auto unmaxpool2D(N new_deltas, const O& outputs, const D& deltas, PoolSize pool_size)
+	//every delta goes to the input that was the maximum of its window, all other inputs get zero
+	template<class S>
+	auto unmaxpool2D(const std::vector<std::size_t>& switches, const xt::xarray<float>& deltas, const S& inputs_shape)
 	{
-		auto& [pool_height, pool_width] = pool_size;
-		for (std::size_t i = 0; i < outputs.shape()[height_axis]; ++i)
-		{
-			const std::size_t i_start = i * pool_height;
-			for (std::size_t k = 0; k < outputs.shape()[width_axis]; ++k)
-			{
-				const std::size_t k_start = k * pool_width;
-				auto pool = xt::view(new_deltas, xt::all(), xt::range(i_start, i_start + pool_height),
-					xt::range(k_start, k_start + pool_width));
-				auto max = xt::view(outputs, xt::all(), xt::range(i, i + 1), xt::range(k, k + 1));
-				xt::filtration(pool, pool < max) = 0;
-				xt::filtration(pool, pool > 0) = 1;
-				pool *= xt::view(deltas, xt::all(), xt::range(i, i + 1), xt::range(k, k + 1));
-			}
-		}
+		xt::xarray<float> new_deltas = xt::zeros<float>(inputs_shape);
+		float* new_deltas_data = new_deltas.data();
+		const float* deltas_data = deltas.data();
+		for (std::size_t j = 0; j < switches.size(); ++j)
+			new_deltas_data[switches[j]] += deltas_data[j];
 		return new_deltas;
 	}
 }
@@ -0,0 +1,83 @@
+#include "neural_network/utils/Profiler.h"
+
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <bit>
+#include <map>
+
+namespace
+{
+	const char* pass_names[] = { "forward", "backward" };
+}
+
+std::size_t nn::Profiler::add(std::string group, std::string name)
+{
+	for (std::size_t index = 0; index < entries.size(); ++index)
+		if (entries[index].name == name)
+			return index;
+	Entry& entry = entries.emplace_back();
+	entry.group = std::move(group);
+	entry.name = std::move(name);
+	return entries.size() - 1;
+}
+
+void nn::Profiler::record(std::size_t entry, Pass pass, std::uint64_t nanoseconds, std::uint64_t flops, std::uint64_t bytes)
+{
+	PassCounters& counters = entries[entry].passes[static_cast<std::size_t>(pass)];
+	counters.calls.fetch_add(1, std::memory_order_relaxed);
+	counters.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+	counters.flops.fetch_add(flops, std::memory_order_relaxed);
+	counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+	const std::size_t bucket = std::min<std::size_t>(std::bit_width(nanoseconds), buckets_number - 1);
+	counters.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void nn::Profiler::reset()
+{
+	for (Entry& entry : entries)
+		for (PassCounters& counters : entry.passes)
+		{
+			counters.calls = 0;
+			counters.nanoseconds = 0;
+			counters.flops = 0;
+			counters.bytes = 0;
+			for (auto& bucket : counters.histogram)
+				bucket = 0;
+		}
+}
+
+void nn::Profiler::dump(std::ostream& out) const
+{
+	//calls, nanoseconds, flops and bytes of both passes
+	using Totals = std::array<std::array<std::uint64_t, 4>, 2>;
+	nlohmann::json layers = nlohmann::json::array();
+	std::map<std::string, Totals> groups_totals;
+	for (const Entry& entry : entries)
+	{
+		nlohmann::json layer{ { "group", entry.group }, { "name", entry.name } };
+		Totals& totals = groups_totals[entry.group];
+		for (std::size_t pass = 0; pass < entry.passes.size(); ++pass)
+		{
+			const PassCounters& counters = entry.passes[pass];
+			std::vector<std::uint64_t> histogram;
+			for (const auto& bucket : counters.histogram)
+				histogram.push_back(bucket.load(std::memory_order_relaxed));
+			const std::array<std::uint64_t, 4> values = { counters.calls.load(std::memory_order_relaxed),
+				counters.nanoseconds.load(std::memory_order_relaxed), counters.flops.load(std::memory_order_relaxed),
+				counters.bytes.load(std::memory_order_relaxed) };
+			layer[pass_names[pass]] = { { "calls", values[0] }, { "nanoseconds", values[1] }, { "flops", values[2] },
+				{ "bytes", values[3] }, { "histogram", histogram } };
+			for (std::size_t i = 0; i < values.size(); ++i)
+				totals[pass][i] += values[i];
+		}
+		layers.push_back(std::move(layer));
+	}
+	nlohmann::json groups = nlohmann::json::object();
+	for (const auto& [group, totals] : groups_totals)
+		for (std::size_t pass = 0; pass < totals.size(); ++pass)
+			groups[group][pass_names[pass]] = { { "calls", totals[pass][0] }, { "nanoseconds", totals[pass][1] },
+				{ "flops", totals[pass][2] }, { "bytes", totals[pass][3] } };
+	const nlohmann::json profile{ { "histogram_bucket", "calls shorter than 2^i nanoseconds" }, { "layers", layers },
+		{ "groups", groups } };
+	out << profile.dump(1, '\t');
+}
@@ -0,0 +1,60 @@
+#ifndef NEURALNETWORK_PROFILER_H
+#define NEURALNETWORK_PROFILER_H
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <string>
+#include <ostream>
+#include <cstddef>
+#include <cstdint>
+
+namespace nn
+{
+	enum class Pass
+	{
+		Forward,
+		Backward
+	};
+
+	//counters of forward and backward calls of layers, layers of a model report to it while it is attached to the model
+	//layers may report from several threads at once, but entries must only be added before layers start reporting
+	//times of calls are counted in a histogram, bucket i holds calls that took less than 2^i nanoseconds
+	class Profiler
+	{
+	public:
+		static constexpr std::size_t buckets_number = 32;
+
+	private:
+		struct PassCounters
+		{
+			std::atomic<std::uint64_t> calls = 0;
+			std::atomic<std::uint64_t> nanoseconds = 0;
+			std::atomic<std::uint64_t> flops = 0;
+			std::atomic<std::uint64_t> bytes = 0;
+			std::array<std::atomic<std::uint64_t>, buckets_number> histogram{};
+		};
+
+		struct Entry
+		{
+			std::string group;
+			std::string name;
+			std::array<PassCounters, 2> passes;
+		};
+
+		//entries are never moved, since they hold atomics
+		std::deque<Entry> entries;
+
+	public:
+		//adds an entry for a layer, returns its index
+		//a name that is already taken returns the existing entry, so copies of a model report as one model
+		std::size_t add(std::string group, std::string name);
+		//flops are an estimate, bytes are the sizes of the tensors the layer produced
+		void record(std::size_t entry, Pass pass, std::uint64_t nanoseconds, std::uint64_t flops, std::uint64_t bytes);
+		void reset();
+		//writes json with counters of every entry and their totals for every group
+		void dump(std::ostream& out) const;
+	};
+}
+
+#endif
@@ -2,13 +2,22 @@
 #define NEURALNETWORK_TAPEFWD_H
 
 #include <unordered_map>
+#include <vector>
 #include <xtensor/containers/xarray.hpp>
 
 namespace nn
 {
 	class Layer;
 
-	using Tape = std::unordered_map<const Layer*, xt::xarray<float>>;
+	//what a layer remembers during forward to be able to compute its derivatives
+	struct TapeRecord
+	{
+		xt::xarray<float> inputs;
+		//flat indices into inputs chosen during forward, for example positions of maximums in pooling windows
+		std::vector<std::size_t> switches;
+	};
+
+	using Tape = std::unordered_map<const Layer*, TapeRecord>;
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,267 @@
+#ifndef NEURALNETWORK_WINOGRADFUNCTIONS_H
+#define NEURALNETWORK_WINOGRADFUNCTIONS_H
+
+#include "neural_network/utils/ConvoluteFunctions.h"
+
+#include <array>
+
+namespace nn
+{
+    //Winograd minimal filtering F(2x2, 3x3): every 2x2 output tile is computed from a 4x4 input tile
+    //with 16 multiplications per channel and filter instead of 36
+    //for every one of the 16 positions of a transformed tile the sum over channels is a matrix product
+    //of transformed filters (filters x channels) and transformed inputs (channels x tiles)
+    //both are written straight into the panel layouts of the gemm micro kernel, so the products need no packing
+    //and tiles, of which there are always more than filters, are on the vectorised side of the micro kernel
+    const std::size_t winograd_tile_positions = 16;
+
+    //number of tiles processed at once by convolute2D_winograd, must be a multiple of gemm_blocking::nr
+    const std::size_t winograd_chunk_size = 128;
+
+    inline bool winograd_applicable(std::size_t kernel_height, std::size_t kernel_width)
+    {
+        return kernel_height == 3 && kernel_width == 3;
+    }
+
+    inline std::size_t winograd_filters_rows(std::size_t filters_number)
+    {
+        return (filters_number + gemm_blocking::mr - 1) / gemm_blocking::mr * gemm_blocking::mr;
+    }
+
+    //U = G g G^T for every filter and channel, filters have (filters, 3, 3, channels) layout
+    //for every position transformed filters are a filters x channels matrix packed as by gemm_pack_a
+    inline void winograd_transform_filters(const xt::xarray<float>& filters, std::vector<float>& transformed)
+    {
+        using gemm_blocking::mr;
+        const std::size_t filters_number = filters.shape()[0];
+        const std::size_t channels = filters.shape()[channels_axis];
+        const std::size_t position_size = winograd_filters_rows(filters_number) * channels;
+        transformed.assign(winograd_tile_positions * position_size, 0.0f);
+        const float* g = filters.data();
+        for (std::size_t f = 0; f < filters_number; ++f)
+            for (std::size_t c = 0; c < channels; ++c)
+            {
+                auto at = [&](std::size_t u, std::size_t v) { return g[((f * 3 + u) * 3 + v) * channels + c]; };
+                //G g
+                float t[4][3];
+                for (std::size_t v = 0; v < 3; ++v)
+                {
+                    t[0][v] = at(0, v);
+                    t[1][v] = (at(0, v) + at(1, v) + at(2, v)) * 0.5f;
+                    t[2][v] = (at(0, v) - at(1, v) + at(2, v)) * 0.5f;
+                    t[3][v] = at(2, v);
+                }
+                //(G g) G^T
+                for (std::size_t u = 0; u < 4; ++u)
+                {
+                    const float row[4] = {
+                        t[u][0],
+                        (t[u][0] + t[u][1] + t[u][2]) * 0.5f,
+                        (t[u][0] - t[u][1] + t[u][2]) * 0.5f,
+                        t[u][2] };
+                    for (std::size_t v = 0; v < 4; ++v)
+                        transformed[(u * 4 + v) * position_size + (f / mr * channels + c) * mr + f % mr] = row[v];
+                }
+            }
+    }
+
+    //copies the 4x4 input tile with its top left corner at (row, col) into a lane of a panel of nr tiles
+    //panel layout is [16][channels][nr], parts of the tile outside of the image are zeroed,
+    //which also implements padding since the corner may lie above or to the left of the image
+    inline void winograd_gather_tile(const float* image, std::size_t inputs_height, std::size_t inputs_width,
+        std::size_t channels, std::ptrdiff_t row, std::ptrdiff_t col, float* panel, std::size_t lane)
+    {
+        using gemm_blocking::nr;
+        for (std::size_t u = 0; u < 4; ++u)
+            for (std::size_t v = 0; v < 4; ++v)
+            {
+                float* dst = panel + (u * 4 + v) * channels * nr + lane;
+                const std::ptrdiff_t inputs_row = row + (std::ptrdiff_t)u;
+                const std::ptrdiff_t inputs_col = col + (std::ptrdiff_t)v;
+                if (inputs_row >= 0 && inputs_row < (std::ptrdiff_t)inputs_height &&
+                    inputs_col >= 0 && inputs_col < (std::ptrdiff_t)inputs_width)
+                {
+                    const float* src = image + (inputs_row * inputs_width + inputs_col) * channels;
+                    for (std::size_t c = 0; c < channels; ++c)
+                        dst[c * nr] = src[c];
+                }
+                else
+                    for (std::size_t c = 0; c < channels; ++c)
+                        dst[c * nr] = 0;
+            }
+    }
+
+    //V = B^T d B for a whole panel of tiles, d and the result both have [16][channels][nr] layout
+    //position p of the result is written to transformed + p * position_stride, d is used as scratch
+    //every combination runs over channels * nr contiguous elements
+    inline void winograd_transform_panel(float* d, std::size_t channels, float* transformed, std::size_t position_stride)
+    {
+        const std::size_t size = channels * gemm_blocking::nr;
+        auto at = [&](std::size_t u, std::size_t v) { return d + (u * 4 + v) * size; };
+        //B^T d, rows of the tiles are combined in place
+        for (std::size_t v = 0; v < 4; ++v)
+        {
+            float* d0 = at(0, v);
+            float* d1 = at(1, v);
+            float* d2 = at(2, v);
+            float* d3 = at(3, v);
+            for (std::size_t j = 0; j < size; ++j)
+            {
+                const float r0 = d0[j] - d2[j];
+                const float r1 = d1[j] + d2[j];
+                const float r2 = d2[j] - d1[j];
+                const float r3 = d1[j] - d3[j];
+                d0[j] = r0;
+                d1[j] = r1;
+                d2[j] = r2;
+                d3[j] = r3;
+            }
+        }
+        //(B^T d) B, columns of the tiles are combined
+        for (std::size_t u = 0; u < 4; ++u)
+        {
+            const float* t0 = at(u, 0);
+            const float* t1 = at(u, 1);
+            const float* t2 = at(u, 2);
+            const float* t3 = at(u, 3);
+            float* v0 = transformed + (u * 4) * position_stride;
+            float* v1 = v0 + position_stride;
+            float* v2 = v1 + position_stride;
+            float* v3 = v2 + position_stride;
+            for (std::size_t j = 0; j < size; ++j)
+            {
+                v0[j] = t0[j] - t2[j];
+                v1[j] = t1[j] + t2[j];
+                v2[j] = t2[j] - t1[j];
+                v3[j] = t1[j] - t3[j];
+            }
+        }
+    }
+
+    //Y = A^T M A for one filter and a panel of nr tiles, position p of M is read from m + p * position_stride
+    //result has [2][2][nr] layout
+    inline void winograd_inverse_panel(const float* m, std::size_t position_stride, float* y)
+    {
+        using gemm_blocking::nr;
+        auto at = [&](std::size_t u, std::size_t v) { return m + (u * 4 + v) * position_stride; };
+        float t[2][4][nr];
+        //A^T M, rows of the tiles are combined
+        for (std::size_t v = 0; v < 4; ++v)
+            for (std::size_t j = 0; j < nr; ++j)
+            {
+                t[0][v][j] = at(0, v)[j] + at(1, v)[j] + at(2, v)[j];
+                t[1][v][j] = at(1, v)[j] - at(2, v)[j] - at(3, v)[j];
+            }
+        //(A^T M) A, columns of the tiles are combined
+        for (std::size_t u = 0; u < 2; ++u)
+            for (std::size_t j = 0; j < nr; ++j)
+            {
+                y[(u * 2 + 0) * nr + j] = t[u][0][j] + t[u][1][j] + t[u][2][j];
+                y[(u * 2 + 1) * nr + j] = t[u][1][j] - t[u][2][j] - t[u][3][j];
+            }
+    }
+
+    //3x3 convolution with stride 1, filters must be transformed with winograd_transform_filters beforehand
+    //inputs are implicitly padded with pad_top rows and pad_left columns of zeros as in convolute2D_gemm
+    //instead of being stored, every 2x2 output tile of every filter is passed to
+    //write_tile(b, i, k, f, y) together with the batch index and the coordinates of its top left corner
+    //tile element (u, v) is y[(u * 2 + v) * gemm_blocking::nr], tiles at the bottom and right edges may stick out of the outputs
+    template<class S, class W>
+    void winograd_convolute(const xt::xarray<float>& inputs, const std::vector<float>& transformed_filters,
+        const S& outputs_shape, std::size_t pad_top, std::size_t pad_left, W write_tile)
+    {
+        using gemm_blocking::mr;
+        using gemm_blocking::nr;
+        const std::size_t inputs_height = inputs.shape()[height_axis];
+        const std::size_t inputs_width = inputs.shape()[width_axis];
+        const std::size_t channels = inputs.shape()[channels_axis];
+        const std::size_t outputs_height = outputs_shape[height_axis];
+        const std::size_t outputs_width = outputs_shape[width_axis];
+        const std::size_t filters_number = outputs_shape[channels_axis];
+        const std::size_t tiles_height = (outputs_height + 1) / 2;
+        const std::size_t tiles_width = (outputs_width + 1) / 2;
+        const std::size_t tiles_total = outputs_shape[0] * tiles_height * tiles_width;
+        const std::size_t filters_position_size = winograd_filters_rows(filters_number) * channels;
+
+        //tile index is split into the batch index and the output coordinates of the tile's top left corner
+        auto tile_origin = [&](std::size_t index) {
+            return std::array{ index / tiles_width / tiles_height, index / tiles_width % tiles_height * 2,
+                index % tiles_width * 2 };
+        };
+
+        thread_local std::vector<float> panel;
+        thread_local std::vector<float> transformed_inputs;
+        thread_local std::vector<float> products;
+        const std::size_t chunk = std::min(tiles_total + nr - 1, winograd_chunk_size) / nr * nr;
+        panel.resize(winograd_tile_positions * channels * nr);
+        transformed_inputs.resize(winograd_tile_positions * chunk * channels);
+        products.resize(winograd_tile_positions * filters_number * chunk);
+
+        for (std::size_t tile_begin = 0; tile_begin < tiles_total; tile_begin += chunk)
+        {
+            const std::size_t tiles = std::min(chunk, tiles_total - tile_begin);
+            for (std::size_t lane_begin = 0; lane_begin < tiles; lane_begin += nr)
+            {
+                for (std::size_t lane = 0; lane < nr; ++lane)
+                {
+                    const auto [b, i, k] = tile_origin(tile_begin + lane_begin + lane);
+                    //lanes past the last tile are gathered as if from an empty image, their results are never written
+                    const std::ptrdiff_t row = (std::ptrdiff_t)i - (std::ptrdiff_t)pad_top;
+                    const std::ptrdiff_t col = (std::ptrdiff_t)k - (std::ptrdiff_t)pad_left;
+                    if (lane_begin + lane < tiles)
+                        winograd_gather_tile(inputs.data() + b * inputs_height * inputs_width * channels,
+                            inputs_height, inputs_width, channels, row, col, panel.data(), lane);
+                    else
+                        winograd_gather_tile(inputs.data(), 0, 0, channels, row, col, panel.data(), lane);
+                }
+                winograd_transform_panel(panel.data(), channels, transformed_inputs.data() + lane_begin * channels,
+                    chunk * channels);
+            }
+            //M[position] = U[position] * V[position], the sum over channels is done by the matrix product
+            for (std::size_t position = 0; position < winograd_tile_positions; ++position)
+            {
+                const float* u = transformed_filters.data() + position * filters_position_size;
+                const float* v = transformed_inputs.data() + position * chunk * channels;
+                float* m = products.data() + position * filters_number * chunk;
+                for (std::size_t jr = 0; jr < tiles; jr += nr)
+                    for (std::size_t ir = 0; ir < filters_number; ir += mr)
+                        gemm_micro_kernel(channels, u + ir * channels, v + jr * channels, m + ir * chunk + jr,
+                            chunk, std::min(mr, filters_number - ir), nr, false);
+            }
+            for (std::size_t lane_begin = 0; lane_begin < tiles; lane_begin += nr)
+                for (std::size_t f = 0; f < filters_number; ++f)
+                {
+                    float y[4 * nr];
+                    winograd_inverse_panel(products.data() + f * chunk + lane_begin, filters_number * chunk, y);
+                    for (std::size_t lane = 0; lane < std::min(nr, tiles - lane_begin); ++lane)
+                    {
+                        const auto [b, i, k] = tile_origin(tile_begin + lane_begin + lane);
+                        write_tile(b, i, k, f, y + lane);
+                    }
+                }
+        }
+    }
+
+    //3x3 convolution with stride 1, produces the same result as convolute2D_gemm
+    template<class S>
+    auto convolute2D_winograd(const xt::xarray<float>& inputs, const std::vector<float>& transformed_filters,
+        const S& outputs_shape, std::size_t pad_top = 0, std::size_t pad_left = 0)
+    {
+        using gemm_blocking::nr;
+        auto outputs = xt::xarray<float>::from_shape(outputs_shape);
+        const std::size_t outputs_height = outputs_shape[height_axis];
+        const std::size_t outputs_width = outputs_shape[width_axis];
+        const std::size_t filters_number = outputs_shape[channels_axis];
+        winograd_convolute(inputs, transformed_filters, outputs_shape, pad_top, pad_left,
+            [&](std::size_t b, std::size_t i, std::size_t k, std::size_t f, const float* y) {
+                //only the part of the 2x2 output tile that lies inside of the outputs is written
+                float* tile_outputs = outputs.data() + ((b * outputs_height + i) * outputs_width + k) * filters_number + f;
+                for (std::size_t u = 0; u < std::min<std::size_t>(2, outputs_height - i); ++u)
+                    for (std::size_t v = 0; v < std::min<std::size_t>(2, outputs_width - k); ++v)
+                        tile_outputs[(u * outputs_width + v) * filters_number] = y[(u * 2 + v) * nr];
+            });
+        return outputs;
+    }
+}
+
+#endif
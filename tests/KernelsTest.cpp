@@ -0,0 +1,332 @@
+#include "neural_network/layers/LayerConv2DMaxPooling2D.h"
+#include "neural_network/layers/LayerDense.h"
+#include "neural_network/utils/ActivationFunctions.h"
+#include "neural_network/utils/ConvoluteFunctions.h"
+#include "neural_network/utils/ConvolutePoolFunctions.h"
+#include "neural_network/utils/GradientMapFwd.h"
+#include "neural_network/utils/PoolFunctions.h"
+#include "neural_network/utils/TapeFwd.h"
+#include "neural_network/utils/WinogradFunctions.h"
+
+#include <xtensor/generators/xrandom.hpp>
+#include <xtensor/reducers/xreducer.hpp>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+//checks the fast kernels of neural_network against the reference ones: convolutions against convolute2D,
+//fused convolution and pooling against convolute2D followed by maxpool2D, derivatives of convolutions against
+//brute force sums and dense layers against products written with xtensor expressions
+//
+//usage: kernels_test convolution|convolution_pooling|convolution_derivatives|dense
+//every group is a separate ctest test, the process fails if any check of the group fails
+
+namespace
+{
+	//errors are relative to the magnitude of the expected value, Winograd transforms lose a few more bits than sums
+	constexpr float tolerance = 1e-4f;
+
+	std::size_t failures = 0;
+
+	void check(const std::string& name, const xt::xarray<float>& actual, const xt::xarray<float>& expected)
+	{
+		if (actual.shape() != expected.shape())
+		{
+			std::cout << "FAILED " << name << ": shapes differ" << std::endl;
+			failures++;
+			return;
+		}
+		float worst_error = 0;
+		for (std::size_t i = 0; i < actual.size(); ++i)
+		{
+			const float error = std::abs(actual.data()[i] - expected.data()[i]) / (1 + std::abs(expected.data()[i]));
+			if (!(error <= worst_error))
+				worst_error = error;
+		}
+		if (worst_error > tolerance || std::isnan(worst_error))
+		{
+			std::cout << "FAILED " << name << ": relative error " << worst_error << std::endl;
+			failures++;
+		}
+	}
+
+	void check(const std::string& name, const std::vector<std::size_t>& actual, const std::vector<std::size_t>& expected)
+	{
+		if (actual != expected)
+		{
+			std::cout << "FAILED " << name << ": switches differ" << std::endl;
+			failures++;
+		}
+	}
+
+	struct ConvolutionCase
+	{
+		std::size_t batch;
+		std::size_t height;
+		std::size_t width;
+		std::size_t channels;
+		std::size_t filters_number;
+		std::size_t kernel_height;
+		std::size_t kernel_width;
+		nn::Padding padding;
+
+		//padding is placed as LayerConv2D places it: for even kernels the extra row and column go to the bottom and right
+		std::size_t pad_top() const { return padding == nn::Padding::Same ? (kernel_height - 1) / 2 : 0; }
+		std::size_t pad_left() const { return padding == nn::Padding::Same ? (kernel_width - 1) / 2 : 0; }
+		std::size_t outputs_height() const { return padding == nn::Padding::Same ? height : height - kernel_height + 1; }
+		std::size_t outputs_width() const { return padding == nn::Padding::Same ? width : width - kernel_width + 1; }
+		std::vector<std::size_t> inputs_shape() const { return { batch, height, width, channels }; }
+		std::vector<std::size_t> filters_shape() const { return { filters_number, kernel_height, kernel_width, channels }; }
+		std::vector<std::size_t> outputs_shape() const { return { batch, outputs_height(), outputs_width(), filters_number }; }
+
+		std::string name() const
+		{
+			return std::to_string(batch) + "x" + std::to_string(height) + "x" + std::to_string(width) + "x" +
+				std::to_string(channels) + " filters " + std::to_string(filters_number) + "x" + std::to_string(kernel_height) +
+				"x" + std::to_string(kernel_width) + (padding == nn::Padding::Same ? " same" : " valid");
+		}
+
+		//inputs with the padding made explicit, so that the reference convolution only has to handle Valid
+		xt::xarray<float> padded(const xt::xarray<float>& inputs) const
+		{
+			const std::size_t padded_height = outputs_height() + kernel_height - 1;
+			const std::size_t padded_width = outputs_width() + kernel_width - 1;
+			xt::xarray<float> result = xt::zeros<float>({ batch, padded_height, padded_width, channels });
+			xt::view(result, xt::all(), xt::range(pad_top(), pad_top() + height), xt::range(pad_left(), pad_left() + width)) =
+				inputs;
+			return result;
+		}
+	};
+
+	std::vector<ConvolutionCase> convolution_cases()
+	{
+		std::vector<ConvolutionCase> cases;
+		const std::vector<std::pair<std::size_t, std::size_t>> kernels{ { 1, 1 }, { 2, 2 }, { 3, 3 }, { 4, 4 }, { 5, 5 }, { 3, 2 } };
+		//the largest shapes take more than one chunk of im2col and of Winograd tiles
+		const std::vector<std::array<std::size_t, 5>> shapes{
+			{ 1, 5, 6, 1, 1 }, { 1, 8, 8, 4, 10 }, { 2, 7, 9, 3, 5 }, { 3, 10, 10, 4, 10 }, { 3, 16, 16, 2, 6 } };
+		for (const auto& [kernel_height, kernel_width] : kernels)
+			for (const auto& [batch, height, width, channels, filters_number] : shapes)
+				for (const nn::Padding padding : { nn::Padding::Valid, nn::Padding::Same })
+					cases.push_back({ batch, height, width, channels, filters_number, kernel_height, kernel_width, padding });
+		return cases;
+	}
+
+	xt::xarray<float> reference_convolution(const ConvolutionCase& c, const xt::xarray<float>& inputs,
+		const xt::xarray<float>& filters)
+	{
+		return nn::convolute2D(c.padded(inputs), filters, c.outputs_shape());
+	}
+
+	//sum over output pixels of deltas times the inputs each weight met
+	xt::xarray<float> reference_filters_derivative(const ConvolutionCase& c, const xt::xarray<float>& inputs,
+		const xt::xarray<float>& deltas)
+	{
+		const xt::xarray<float> padded = c.padded(inputs);
+		xt::xarray<float> derivative = xt::zeros<float>(c.filters_shape());
+		for (std::size_t b = 0; b < c.batch; ++b)
+			for (std::size_t i = 0; i < c.outputs_height(); ++i)
+				for (std::size_t k = 0; k < c.outputs_width(); ++k)
+					for (std::size_t f = 0; f < c.filters_number; ++f)
+						for (std::size_t u = 0; u < c.kernel_height; ++u)
+							for (std::size_t v = 0; v < c.kernel_width; ++v)
+								for (std::size_t ch = 0; ch < c.channels; ++ch)
+									derivative(f, u, v, ch) += deltas(b, i, k, f) * padded(b, i + u, k + v, ch);
+		return derivative;
+	}
+
+	//every output pixel sends deltas times weights back to the inputs it was computed from, padding is dropped
+	xt::xarray<float> reference_inputs_derivative(const ConvolutionCase& c, const xt::xarray<float>& filters,
+		const xt::xarray<float>& deltas)
+	{
+		xt::xarray<float> padded = xt::zeros<float>(c.padded(xt::zeros<float>(c.inputs_shape())).shape());
+		for (std::size_t b = 0; b < c.batch; ++b)
+			for (std::size_t i = 0; i < c.outputs_height(); ++i)
+				for (std::size_t k = 0; k < c.outputs_width(); ++k)
+					for (std::size_t f = 0; f < c.filters_number; ++f)
+						for (std::size_t u = 0; u < c.kernel_height; ++u)
+							for (std::size_t v = 0; v < c.kernel_width; ++v)
+								for (std::size_t ch = 0; ch < c.channels; ++ch)
+									padded(b, i + u, k + v, ch) += deltas(b, i, k, f) * filters(f, u, v, ch);
+		return xt::view(padded, xt::all(), xt::range(c.pad_top(), c.pad_top() + c.height),
+			xt::range(c.pad_left(), c.pad_left() + c.width));
+	}
+
+	//layers hide the public forward and backward of Layer behind their own overloads, so they are called through Layer
+	//as a model calls them
+	const nn::Layer& as_layer(const nn::Layer& layer)
+	{
+		return layer;
+	}
+
+	//the layer gets the given filters and zero biases, so its outputs are the bare convolution
+	template<class L>
+	void set_trainable_vars(L& layer, const xt::xarray<float>& weights)
+	{
+		nn::TrainableVars trainable_vars;
+		layer.get_trainable_vars(trainable_vars);
+		*trainable_vars[0] = weights;
+		trainable_vars[1]->fill(0);
+		layer.trainable_vars_updated();
+	}
+
+	void test_convolution()
+	{
+		for (const ConvolutionCase& c : convolution_cases())
+		{
+			const xt::xarray<float> inputs = xt::random::rand<float>(c.inputs_shape(), -1, 1);
+			const xt::xarray<float> filters = xt::random::rand<float>(c.filters_shape(), -1, 1);
+			const xt::xarray<float> expected = reference_convolution(c, inputs, filters);
+			check("convolute2D_gemm " + c.name(), nn::convolute2D_gemm(inputs, filters, c.outputs_shape(), c.pad_top(),
+				c.pad_left()), expected);
+			if (nn::winograd_applicable(c.kernel_height, c.kernel_width))
+			{
+				std::vector<float> transformed_filters;
+				nn::winograd_transform_filters(filters, transformed_filters);
+				check("convolute2D_winograd " + c.name(), nn::convolute2D_winograd(inputs, transformed_filters,
+					c.outputs_shape(), c.pad_top(), c.pad_left()), expected);
+			}
+
+			nn::LayerConv2D layer(c.filters_number, { c.kernel_height, c.kernel_width }, c.padding, nn::Activation::Identity);
+			std::vector<std::size_t> shape = c.inputs_shape();
+			layer.build(shape);
+			set_trainable_vars(layer, filters);
+			xt::xarray<float> outputs = inputs;
+			as_layer(layer).forward(outputs, nullptr);
+			check("LayerConv2D " + c.name(), outputs, expected);
+		}
+	}
+
+	void test_convolution_pooling()
+	{
+		for (const ConvolutionCase& c : convolution_cases())
+			for (const nn::PoolSize& pool_size : { nn::PoolSize{ 2, 2 }, nn::PoolSize{ 3, 3 }, nn::PoolSize{ 2, 3 } })
+			{
+				const std::string name = c.name() + " pool " + std::to_string(pool_size.first) + "x" +
+					std::to_string(pool_size.second);
+				const xt::xarray<float> inputs = xt::random::rand<float>(c.inputs_shape(), -1, 1);
+				const xt::xarray<float> filters = xt::random::rand<float>(c.filters_shape(), -1, 1);
+				const std::vector<std::size_t> pooled_shape = { c.batch, (c.outputs_height() - 1) / pool_size.first + 1,
+					(c.outputs_width() - 1) / pool_size.second + 1, c.filters_number };
+				std::vector<std::size_t> expected_switches;
+				const xt::xarray<float> expected = nn::maxpool2D(reference_convolution(c, inputs, filters), pooled_shape,
+					pool_size, &expected_switches);
+
+				std::vector<std::size_t> switches(expected_switches.size());
+				check("convolute2D_maxpool2D_gemm " + name, nn::convolute2D_maxpool2D_gemm(inputs, filters, c.pad_top(),
+					c.pad_left(), c.outputs_height(), c.outputs_width(), pool_size, pooled_shape, switches.data()), expected);
+				check("convolute2D_maxpool2D_gemm switches " + name, switches, expected_switches);
+				if (nn::winograd_applicable(c.kernel_height, c.kernel_width) && pool_size == nn::PoolSize{ 2, 2 })
+				{
+					std::vector<float> transformed_filters;
+					nn::winograd_transform_filters(filters, transformed_filters);
+					check("convolute2D_maxpool2D_winograd " + name, nn::convolute2D_maxpool2D_winograd(inputs,
+						transformed_filters, c.pad_top(), c.pad_left(), c.outputs_height(), c.outputs_width(), pooled_shape,
+						switches.data()), expected);
+					check("convolute2D_maxpool2D_winograd switches " + name, switches, expected_switches);
+				}
+
+				nn::LayerConv2DMaxPooling2D layer(c.filters_number, { c.kernel_height, c.kernel_width }, c.padding,
+					nn::Activation::Identity, pool_size);
+				std::vector<std::size_t> shape = c.inputs_shape();
+				layer.build(shape);
+				set_trainable_vars(layer, filters);
+				xt::xarray<float> outputs = inputs;
+				as_layer(layer).forward(outputs, nullptr);
+				check("LayerConv2DMaxPooling2D " + name, outputs, expected);
+			}
+	}
+
+	void test_convolution_derivatives()
+	{
+		for (const ConvolutionCase& c : convolution_cases())
+		{
+			const xt::xarray<float> inputs = xt::random::rand<float>(c.inputs_shape(), -1, 1);
+			const xt::xarray<float> filters = xt::random::rand<float>(c.filters_shape(), -1, 1);
+			const xt::xarray<float> deltas = xt::random::rand<float>(c.outputs_shape(), -1, 1);
+			const xt::xarray<float> expected_filters_derivative = reference_filters_derivative(c, inputs, deltas);
+			const xt::xarray<float> expected_inputs_derivative = reference_inputs_derivative(c, filters, deltas);
+			check("convolute2D_filters_derivative " + c.name(), nn::convolute2D_filters_derivative(inputs, deltas,
+				c.filters_shape(), c.pad_top(), c.pad_left()), expected_filters_derivative);
+			check("convolute2D_inputs_derivative " + c.name(), nn::convolute2D_inputs_derivative(deltas, filters,
+				c.inputs_shape(), c.pad_top(), c.pad_left()), expected_inputs_derivative);
+
+			nn::LayerConv2D layer(c.filters_number, { c.kernel_height, c.kernel_width }, c.padding, nn::Activation::Identity);
+			std::vector<std::size_t> shape = c.inputs_shape();
+			layer.build(shape);
+			set_trainable_vars(layer, filters);
+			nn::Tape tape;
+			nn::GradientMap gradient_map;
+			xt::xarray<float> outputs = inputs;
+			as_layer(layer).forward(outputs, &tape);
+			xt::xarray<float> layer_deltas = deltas;
+			as_layer(layer).backward(outputs, layer_deltas, tape, gradient_map);
+			check("LayerConv2D weights derivative " + c.name(), gradient_map[{ &layer, nn::TrainableVarsType::Weights }],
+				expected_filters_derivative);
+			check("LayerConv2D biases derivative " + c.name(), gradient_map[{ &layer, nn::TrainableVarsType::Biases }],
+				xt::sum(deltas, { 0, 1, 2 }));
+			check("LayerConv2D deltas " + c.name(), layer_deltas, expected_inputs_derivative);
+		}
+	}
+
+	//batches of one take the gemv path of gemm, the largest sizes take more than one cache block
+	void test_dense()
+	{
+		for (const std::size_t batch : { 1, 5, 100 })
+			for (const auto& [inputs_number, outputs_number] : { std::pair<std::size_t, std::size_t>{ 1, 1 }, { 17, 20 },
+				{ 300, 80 }, { 40, 1 } })
+			{
+				const std::string name = std::to_string(batch) + "x" + std::to_string(inputs_number) + " outputs " +
+					std::to_string(outputs_number);
+				const xt::xarray<float> inputs = xt::random::rand<float>({ batch, inputs_number }, -1, 1);
+				const xt::xarray<float> deltas = xt::random::rand<float>({ batch, outputs_number }, -1, 1);
+				nn::LayerDense layer(outputs_number, nn::Activation::Identity);
+				std::vector<std::size_t> shape{ batch, inputs_number };
+				layer.build(shape);
+				nn::TrainableVars trainable_vars;
+				layer.get_trainable_vars(trainable_vars);
+				*trainable_vars[0] = xt::random::rand<float>({ outputs_number, inputs_number }, -1, 1);
+				*trainable_vars[1] = xt::random::rand<float>({ outputs_number }, -1, 1);
+				const xt::xarray<float> weights = *trainable_vars[0];
+				const xt::xarray<float> biases = *trainable_vars[1];
+
+				nn::Tape tape;
+				nn::GradientMap gradient_map;
+				xt::xarray<float> outputs = inputs;
+				as_layer(layer).forward(outputs, &tape);
+				check("LayerDense forward " + name, outputs,
+					xt::sum(xt::view(inputs, xt::all(), xt::newaxis(), xt::all()) * weights, { 2 }) + biases);
+				xt::xarray<float> layer_deltas = deltas;
+				as_layer(layer).backward(outputs, layer_deltas, tape, gradient_map);
+				check("LayerDense weights derivative " + name, gradient_map[{ &layer, nn::TrainableVarsType::Weights }],
+					xt::sum(xt::view(deltas, xt::all(), xt::all(), xt::newaxis()) *
+						xt::view(inputs, xt::all(), xt::newaxis(), xt::all()), { 0 }));
+				check("LayerDense biases derivative " + name, gradient_map[{ &layer, nn::TrainableVarsType::Biases }],
+					xt::sum(deltas, { 0 }));
+				check("LayerDense deltas " + name, layer_deltas,
+					xt::sum(xt::view(deltas, xt::all(), xt::all(), xt::newaxis()) * weights, { 1 }));
+			}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const std::map<std::string, std::function<void()>> groups{
+		{ "convolution", test_convolution },
+		{ "convolution_pooling", test_convolution_pooling },
+		{ "convolution_derivatives", test_convolution_derivatives },
+		{ "dense", test_dense } };
+	const auto group = argc == 2 ? groups.find(argv[1]) : groups.end();
+	if (group == groups.end())
+	{
+		std::cerr << "usage: kernels_test convolution|convolution_pooling|convolution_derivatives|dense" << std::endl;
+		return 2;
+	}
+	xt::random::seed(0);
+	group->second();
+	return failures == 0 ? 0 : 1;
+}